@@ -0,0 +1,291 @@
+/*
+ * Micro-benchmark of the sampling engines of the header-only library
+ * (inst/include/waffect), built without R (see Makefile).
+ *
+ *   ./bench [--quick] [--max-n N] [--max-seconds S] [--mem BYTES] [--seed K]
+ *
+ * Sweeps n, r, the checkpoint segment length h of the backward table and
+ * the distribution of pi, and writes one JSON record per configuration on
+ * stdout:
+ *   engine, pi, n, r, h, replicates, seconds, ns_per_individual,
+ *   replicates_per_sec, bytes_allocated (per replicate, setup included)
+ * Configurations that the planner (planner.h) estimates slower than
+ * --max-seconds per replicate, or tables above --mem bytes, are skipped.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <waffect/core.h>
+
+/* the engines used below */
+using waffect::backward;
+using waffect::backward_kernel_name;
+using waffect::backward_row;
+using waffect::btable;
+using waffect::forward;
+using waffect::forward_budget;
+using waffect::forward_checkpoint;
+using waffect::grouped;
+using waffect::make_plan;
+using waffect::mcmc_run;
+using waffect::mcmcopt;
+using waffect::philox;
+using waffect::plan;
+using waffect::PLAN_BACKWARD;
+using waffect::PLAN_FFT;
+using waffect::PLAN_GROUPED;
+using waffect::PLAN_REJECT;
+using waffect::ptree;
+using waffect::xdouble;
+
+/* allocation counter: with glibc every malloc is intercepted (operator new
+ * and btable included), elsewhere only operator new is */
+static std::atomic<unsigned long long> allocated(0);
+
+#ifdef __GLIBC__
+extern "C" {
+  void *__libc_malloc(size_t);
+  void *__libc_calloc(size_t,size_t);
+  void *__libc_realloc(void *,size_t);
+  void *malloc(size_t n) { allocated+=n; return __libc_malloc(n); }
+  void *calloc(size_t k,size_t n) { allocated+=k*n; return __libc_calloc(k,n); }
+  void *realloc(void *p,size_t n) { allocated+=n; return __libc_realloc(p,n); }
+}
+#else
+#include <new>
+void *operator new(size_t n) {
+  allocated+=n;
+  if (void *p=std::malloc(n ? n : 1))
+    return p;
+  throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p,size_t) noexcept { std::free(p); }
+#endif
+
+static double now() {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct options {
+  size_t maxn;
+  double maxseconds,mem,mintime;
+  uint64_t seed;
+  bool quick;
+};
+
+/* pi distributions */
+static const char *shapes[]={"uniform","skewed","few","extreme"};
+
+static std::vector<double> make_pi(const char *shape,size_t n,philox &g) {
+  std::vector<double> pi(n);
+  static const double few[4]={0.02,0.05,0.1,0.3};
+  for (size_t i=0; i<n; i++) {
+    double u=g.unif();
+    if (!strcmp(shape,"uniform"))
+      pi[i]=u;
+    else if (!strcmp(shape,"skewed"))
+      pi[i]=u*u*u*u;
+    else if (!strcmp(shape,"few"))
+      pi[i]=few[g.index(4)];
+    else   // near 0 or 1, a few exactly 0 or 1
+      pi[i]=u<0.05 ? 0.0 : (u<0.1 ? 1.0 : (u<0.55 ? 1e-6*g.unif() : 1.0-1e-6*g.unif()));
+  }
+  return pi;
+}
+
+struct record {
+  const char *engine,*shape;
+  size_t n,r,h,reps;
+  double seconds;
+  unsigned long long bytes;
+};
+
+static bool first_record=true;
+
+static void print(const record &x) {
+  double per=x.seconds/x.reps;
+  printf("%s\n  {\"engine\": \"%s\", \"pi\": \"%s\", \"n\": %zu, \"r\": %zu, \"h\": %zu, "
+	 "\"replicates\": %zu, \"seconds\": %.6g, \"ns_per_individual\": %.4g, "
+	 "\"replicates_per_sec\": %.6g, \"bytes_allocated\": %llu}",
+	 first_record ? "" : ",",x.engine,x.shape,x.n,x.r,x.h,x.reps,x.seconds,
+	 1e9*per/x.n,1.0/per,x.bytes/x.reps);
+  first_record=false;
+  fflush(stdout);
+}
+
+/* run f(k) for k=0,1,... until mintime seconds (at least once) */
+template <class F>
+static void timed(record &x,const options &o,F f) {
+  unsigned long long before=allocated;
+  double start=now();
+  x.reps=0;
+  do {
+    f(x.reps);
+    x.reps++;
+  } while (now()-start<o.mintime && x.reps<100000);
+  x.seconds=now()-start;
+  x.bytes=allocated-before;
+  print(x);
+}
+
+static void sweep(const options &o) {
+  std::vector<size_t> sizes;
+  for (size_t n=1000; n<=o.maxn; n*=(o.quick ? 100 : 10))
+    sizes.push_back(n);
+  const double fractions[]={0.01,0.1,0.5};
+  philox g(o.seed);
+
+  for (size_t s=0; s<4; s++)
+    for (size_t a=0; a<sizes.size(); a++)
+      for (size_t b=0; b<3; b++) {
+	size_t n=sizes[a],r=(size_t)(fractions[b]*n);
+	std::vector<double> pi=make_pi(shapes[s],n,g);
+	const double *p=&pi[0];
+	std::vector<int> res(n);
+	plan P;
+	try {
+	  P=make_plan(p,n,r,1,0.0);
+	} catch (std::exception &e) {
+	  continue;   // r not reachable with this pi
+	}
+	record x={"",shapes[s],n,r,0,0,0.0,0};
+	double row=(double)btable<xdouble>::rowbytes(r+2);
+
+	// backward table, whole (h=n) and checkpointed (h=sqrt(n))
+	size_t k=(size_t)ceil(sqrt((double)n));
+	size_t hs[2]={n,k};
+	for (int t=0; t<2; t++) {
+	  if (P.cost[PLAN_BACKWARD]*(t+1)>o.maxseconds || (t==0 && n*row>o.mem))
+	    continue;
+	  x.h=hs[t];
+	  try {
+	    x.engine="backward_scaled";
+	    timed(x,o,[&](size_t rep) {
+		philox h(rep);
+		if (t==0)
+		  forward_budget<double>(r,0.0,p,n,&res[0],h);
+		else
+		  forward_checkpoint<double>(r,k,p,n,&res[0],h);
+	      });
+	  } catch (std::range_error &) {
+	    // underflow of the scaled table (near 0/1 models)
+	  }
+	  if (P.cost[PLAN_BACKWARD]*(t+1)*5.0>o.maxseconds)
+	    continue;
+	  x.engine="backward_xdouble";
+	  timed(x,o,[&](size_t rep) {
+	      philox h(rep);
+	      if (t==0)
+		forward_budget<xdouble>(r,0.0,p,n,&res[0],h);
+	      else
+		forward_checkpoint<xdouble>(r,k,p,n,&res[0],h);
+	    });
+	}
+	x.h=0;
+
+	// table built once, replicates only
+	if (P.cost[PLAN_BACKWARD]<o.maxseconds && n*row/2<o.mem) {
+	  btable<double> B(n,r+2);
+	  try {
+	    backward(r,n,0,p,n,B);
+	    x.engine="forward_scaled";
+	    x.h=n;
+	    timed(x,o,[&](size_t rep) { philox h(rep); forward(p,n,B,&res[0],h); });
+	    x.h=0;
+	  } catch (std::range_error &) {
+	  }
+	}
+
+	if (P.cost[PLAN_FFT]<o.maxseconds) {
+	  x.engine="fft";
+	  timed(x,o,[&](size_t rep) {
+	      ptree T(p,n,r);
+	      std::vector<size_t> cases;
+	      T.sample(&res[0],o.seed,rep,cases);
+	    });
+	}
+	if (P.cost[PLAN_GROUPED]<o.maxseconds) {
+	  x.engine="grouped";
+	  timed(x,o,[&](size_t rep) {
+	      grouped G(p,n,r);
+	      std::vector<size_t> work;
+	      philox h(rep);
+	      G.sample(&res[0],h,work);
+	    });
+	}
+	if (P.cost[PLAN_REJECT]<o.maxseconds) {
+	  x.engine="reject";
+	  timed(x,o,[&](size_t rep) { philox h(rep); reject(p,n,r,&res[0],h); });
+	}
+
+	// mcmc: 10 sweeps of n steps from a random start
+	mcmcopt opt;
+	opt.burnin=10*n;
+	opt.maxburnin=opt.burnin;
+	opt.thin=n;
+	for (int w=0; w<2; w++) {
+	  opt.weighted=w;
+	  x.engine=w ? "mcmc_weighted_10sweeps" : "mcmc_uniform_10sweeps";
+	  timed(x,o,[&](size_t rep) { philox h(rep); mcmc_run(p,n,r,opt,&res[0],1,h); });
+	}
+      }
+}
+
+/* one backward row of r cells, xdouble against the double kernel */
+static void arithmetic(const options &o) {
+  size_t r=o.quick ? 1000 : 10000;
+  btable<xdouble> X(2,r+2);
+  btable<double> D(2,r+2);
+  for (size_t m=0; m<r+2; m++) {
+    X[1][m]=1.0/(m+1.0);
+    D[1][m]=1.0/(m+1.0);
+  }
+  record x={"","row",r,r,0,0,0.0,0};
+  x.engine="xdouble_row";
+  timed(x,o,[&](size_t) { backward_row(X[0],X[1],0.3,0,r-1); });
+  x.engine="double_row";
+  timed(x,o,[&](size_t) { backward_row(D[0],D[1],0.3,0,r-1); });
+}
+
+int main(int argc,char **argv) {
+  options o;
+  o.maxn=100000;
+  o.maxseconds=2.0;
+  o.mem=2e9;
+  o.mintime=0.2;
+  o.seed=1;
+  o.quick=false;
+  for (int i=1; i<argc; i++) {
+    std::string a=argv[i];
+    if (a=="--quick") {
+      o.quick=true;
+      o.maxn=10000;
+      o.maxseconds=0.2;
+      o.mintime=0.02;
+    } else if (a=="--max-n" && i+1<argc) {
+      o.maxn=strtoull(argv[++i],0,10);
+    } else if (a=="--max-seconds" && i+1<argc) {
+      o.maxseconds=atof(argv[++i]);
+    } else if (a=="--mem" && i+1<argc) {
+      o.mem=atof(argv[++i]);
+    } else if (a=="--seed" && i+1<argc) {
+      o.seed=strtoull(argv[++i],0,10);
+    } else {
+      fprintf(stderr,"usage: %s [--quick] [--max-n N] [--max-seconds S] [--mem BYTES] [--seed K]\n",argv[0]);
+      return 1;
+    }
+  }
+  printf("{\"kernel\": \"%s\", \"results\": [",backward_kernel_name());
+  arithmetic(o);
+  sweep(o);
+  printf("\n]}\n");
+  return 0;
+}
@@ -0,0 +1,293 @@
+/*
+ * Streaming phenotype generator, built without R (see Makefile): writes nsim
+ * binary replicates in a PLINK alternate phenotype file (--pheno ... --all-pheno)
+ *
+ *   FID IID P1 P2 ... Pk
+ *   1   1   2  1  ... 1
+ *
+ *   waffect-pheno --prob FILE --count N1 --nsim K -o OUT [options]
+ *
+ * FILE has one individual per line: "pi" or "FID IID pi" (blank lines and
+ * lines starting with # are skipped); without ids, FID=IID=line number as in
+ * the vignette. --n N instead of --prob simulates under H0 (pi=0.1).
+ *
+ * The replicates are generated by blocks of --block columns and written in
+ * place: every label has the same width, so that the offset of each field is
+ * known and the file is filled block after block. The memory is the sampler
+ * (bounded by --mem) plus one block, whatever nsim. Consecutive writes are
+ * merged in one buffer; when a single block holds all the replicates the
+ * file is written sequentially.
+ *
+ * Replicate k is drawn from stream k of the seed: the output only depends on
+ * the seed, not on --threads or --block.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <stdexcept>
+#include <waffect/core.h>
+
+#ifdef _WIN32
+#define fseeko _fseeki64
+typedef long long off_t;
+#endif
+
+struct options {
+  std::string prob,out,method;
+  size_t n,count,controls,nsim,block;
+  std::string label[2];
+  int threads;
+  uint64_t seed;
+  bool seeded,header;
+  double mem;
+};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+	  "usage: %s (--prob FILE | --n N) --count N1[,N0] -o OUT [options]\n"
+	  "  --nsim K          number of replicates (1)\n"
+	  "  --label A,B       labels of the cases and controls (2,1)\n"
+	  "  --method M        backward, fft, grouped, reject or auto (auto)\n"
+	  "  --threads T       number of threads (1)\n"
+	  "  --seed S          seed of the generator (random, printed on stderr)\n"
+	  "  --mem BYTES       memory budget of the sampler (1e9)\n"
+	  "  --block K         replicates per block (as many as fit in 64 MB)\n"
+	  "  --no-header       no FID IID P1 ... line\n",name);
+  exit(1);
+}
+
+/* "a,b" in two strings (b empty if absent) */
+static void pair(const std::string &s,std::string &a,std::string &b) {
+  size_t c=s.find(',');
+  a=s.substr(0,c);
+  b=c==std::string::npos ? "" : s.substr(c+1);
+}
+
+/* pi and ids, one individual per line */
+static void read_prob(const std::string &file,std::vector<double> &pi,std::vector<std::string> &fid,std::vector<std::string> &iid) {
+  std::ifstream in(file.c_str());
+  if (!in)
+    throw std::runtime_error("cannot open "+file);
+  std::string line,a,b,c,extra;
+  size_t lineno=0;
+  while (std::getline(in,line)) {
+    lineno++;
+    std::istringstream fields(line);
+    if (!(fields>>a) || a[0]=='#')
+      continue;
+    if (fields>>b) {
+      if (!(fields>>c) || (fields>>extra))
+	throw std::runtime_error(file+": line "+std::to_string(lineno)+": expected \"pi\" or \"FID IID pi\"");
+      fid.push_back(a);
+      iid.push_back(b);
+    } else {
+      c=a;
+      fid.push_back(std::to_string(pi.size()+1));
+      iid.push_back(fid.back());
+    }
+    char *end;
+    double p=strtod(c.c_str(),&end);
+    if (*end || !(p>=0.0 && p<=1.0))
+      throw std::runtime_error(file+": line "+std::to_string(lineno)+": pi must be in [0,1]");
+    pi.push_back(p);
+  }
+}
+
+/* writes at given offsets of a file, merging the contiguous ones */
+class writer {
+  FILE *f;
+  std::vector<char> buf;
+  off_t start;
+  size_t used;
+
+public:
+  writer(const std::string &file) : buf(1<<22), start(0), used(0) {
+    f=fopen(file.c_str(),"wb");
+    if (!f)
+      throw std::runtime_error("cannot open "+file);
+  }
+
+  ~writer() {
+    if (f)
+      fclose(f);
+  }
+
+  void put(off_t at,const char *s,size_t n) {
+    if (used>0 && (at!=start+(off_t)used || used+n>buf.size()))
+      flush();
+    if (used==0)
+      start=at;
+    if (n>buf.size())
+      buf.resize(n);
+    memcpy(&buf[used],s,n);
+    used+=n;
+  }
+
+  void flush() {
+    if (used>0 && (fseeko(f,start,SEEK_SET)!=0 || fwrite(&buf[0],1,used,f)!=used))
+      throw std::runtime_error("write error");
+    used=0;
+  }
+
+  void close() {
+    flush();
+    int err=fclose(f);
+    f=0;
+    if (err)
+      throw std::runtime_error("write error");
+  }
+};
+
+static void run(const options &o) {
+  std::vector<double> pi;
+  std::vector<std::string> fid,iid;
+  if (!o.prob.empty())
+    read_prob(o.prob,pi,fid,iid);
+  else
+    for (size_t i=0; i<o.n; i++) {
+      pi.push_back(0.1);
+      fid.push_back(std::to_string(i+1));
+      iid.push_back(fid.back());
+    }
+  size_t q=pi.size();
+  if (q==0)
+    throw std::invalid_argument("no individual");
+  if (o.count>q)
+    throw std::invalid_argument("more cases than individuals");
+  if (o.controls!=(size_t)-1 && o.count+o.controls!=q)
+    throw std::invalid_argument("the counts do not sum to the number of individuals");
+
+  static const char *names[]={"backward","mcmc","reject","fft","grouped","auto"};
+  int method=-1;
+  for (int k=0; k<6; k++)
+    if (o.method==names[k] && k!=waffect::MCMC)
+      method=k;
+  if (method<0)
+    throw std::invalid_argument("unknown method "+o.method);
+  waffect::generator gen(&pi[0],q,o.count,method,false,o.mem,o.nsim,o.threads);
+  fprintf(stderr,"waffect-pheno: %zu individuals, %zu cases, %zu replicates, method %s, seed %llu\n",
+	  q,o.count,o.nsim,names[gen.method],(unsigned long long)o.seed);
+
+  // fields of constant width: " label" padded with spaces
+  size_t w=std::max(o.label[0].size(),o.label[1].size())+1;
+  std::string field[2];
+  for (int k=0; k<2; k++)
+    field[k]=" "+o.label[1-k]+std::string(w-1-o.label[1-k].size(),' ');
+
+  writer out(o.out);
+  off_t at=0;
+  if (o.header) {
+    std::string s="FID IID";
+    out.put(at,s.data(),s.size());
+    at+=s.size();
+    for (size_t k=0; k<o.nsim; k++) {
+      s=" P"+std::to_string(k+1);
+      if (k+1==o.nsim)
+	s+="\n";
+      out.put(at,s.data(),s.size());
+      at+=s.size();
+    }
+  }
+
+  // line i begins at line[i] with "FID IID", its fields at line[i]+prefix[i]
+  std::vector<off_t> line(q);
+  std::vector<size_t> prefix(q);
+  for (size_t i=0; i<q; i++) {
+    line[i]=at;
+    prefix[i]=fid[i].size()+1+iid[i].size();
+    at+=prefix[i]+o.nsim*w+1;
+  }
+
+  size_t block=o.block ? o.block : (64u<<20)/(q*sizeof(int));
+  block=std::max<size_t>(1,std::min(block,o.nsim));
+  std::vector<int> res(q*block);
+  std::string s;
+  for (size_t first=0; first<o.nsim; first+=block) {
+    size_t m=std::min(block,o.nsim-first);
+    gen.block(&res[0],first,m,o.seed,o.threads);
+    bool last=first+m==o.nsim;
+    for (size_t i=0; i<q; i++) {
+      s.clear();
+      if (first==0)
+	s=fid[i]+" "+iid[i];
+      for (size_t k=0; k<m; k++)
+	s+=field[res[k*q+i]!=0];
+      if (last)
+	s+="\n";
+      out.put(line[i]+(first==0 ? 0 : prefix[i]+first*w),s.data(),s.size());
+    }
+  }
+  out.close();
+}
+
+int main(int argc,char **argv) {
+  options o;
+  o.n=0;
+  o.count=(size_t)-1;
+  o.controls=(size_t)-1;
+  o.nsim=1;
+  o.block=0;
+  o.label[0]="2";
+  o.label[1]="1";
+  o.method="auto";
+  o.threads=1;
+  o.seeded=false;
+  o.header=true;
+  o.mem=1e9;
+  for (int i=1; i<argc; i++) {
+    std::string a=argv[i];
+    bool more=i+1<argc;
+    if (a=="--prob" && more)
+      o.prob=argv[++i];
+    else if (a=="--n" && more)
+      o.n=strtoull(argv[++i],0,10);
+    else if (a=="--count" && more) {
+      std::string n1,n0;
+      pair(argv[++i],n1,n0);
+      o.count=strtoull(n1.c_str(),0,10);
+      o.controls=n0.empty() ? (size_t)-1 : strtoull(n0.c_str(),0,10);
+    } else if (a=="--label" && more) {
+      pair(argv[++i],o.label[0],o.label[1]);
+      if (o.label[0].empty() || o.label[1].empty())
+	usage(argv[0]);
+    } else if (a=="--nsim" && more)
+      o.nsim=strtoull(argv[++i],0,10);
+    else if (a=="--method" && more)
+      o.method=argv[++i];
+    else if (a=="--threads" && more)
+      o.threads=atoi(argv[++i]);
+    else if (a=="--seed" && more) {
+      o.seed=strtoull(argv[++i],0,10);
+      o.seeded=true;
+    } else if (a=="--mem" && more)
+      o.mem=atof(argv[++i]);
+    else if (a=="--block" && more)
+      o.block=strtoull(argv[++i],0,10);
+    else if (a=="--no-header")
+      o.header=false;
+    else if ((a=="-o" || a=="--out") && more)
+      o.out=argv[++i];
+    else
+      usage(argv[0]);
+  }
+  if (o.prob.empty()==(o.n==0) || o.count==(size_t)-1 || o.out.empty() || o.nsim==0 || o.threads<1)
+    usage(argv[0]);
+  if (!o.seeded) {
+    std::random_device rd;
+    o.seed=((uint64_t)rd()<<32)|rd();
+  }
+
+  try {
+    run(o);
+  } catch (std::exception &e) {
+    fprintf(stderr,"waffect-pheno: %s\n",e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,319 @@
+#ifndef _waffect_BACKWARD_H
+#define _waffect_BACKWARD_H
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include "xdouble.h"
+#include "btable.h"
+#include "kernel.h"
+#include "rng.h"
+#include "tilt.h"
+
+namespace waffect {
+
+/*
+ * Two numeric representations are available for the backward table:
+ *  - btable<xdouble>: every cell carries its own exponent (always safe);
+ *  - btable<double>: plain double cells, row i stands for B[i][m]*2^B.scale(i)
+ *    (one exponent per row, half the memory, branch free inner loop). Cells
+ *    smaller than 2^-1074 times the row maximum are lost. The table is built
+ *    on the pi tilted so that r cases are expected (table_pi): the
+ *    distribution given r cases is the same, and the cells met when sampling
+ *    are then those near the maximum of their row, the lost ones being
+ *    reached with negligible probability. Otherwise (pi small and r large,
+ *    say) the rows span far more than 2^1074 and the sampling path runs
+ *    through the lost cells. A path that still meets a zero is detected.
+ */
+
+/* rows whose largest cell falls below 2^-64 are renormalized */
+const double ROW_RESCALE=5.421010862427522e-20;
+
+/* one step of the recursion, cur[m]=p*prev[m+1]+(1-p)*prev[m] for m=lo..hi,
+ * returns the binary exponent e taken out of the row (multiplied by 2^-e) */
+inline long backward_row(xdouble *cur,const xdouble *prev,double p,size_t lo,size_t hi) {
+  xdouble p1=p,p0=1.0-p;
+  for (size_t m=lo; m<=hi; m++)
+    cur[m]=p1*prev[m+1]+p0*prev[m];
+  return 0;
+};
+
+inline long backward_row(double *cur,const double *prev,double p,size_t lo,size_t hi) {
+  double largest=backward_kernel(cur,prev,p,lo,hi);
+  if (largest>=ROW_RESCALE || largest==0.0)
+    return 0;
+  // multiply by a power of two: exact, the mantissas are unchanged
+  int e;
+  frexp(largest,&e);
+  double f=ldexp(1.0,-e);
+  for (size_t m=lo; m<=hi; m++)
+    cur[m]*=f;
+  return e;
+};
+
+/* p: the pi a table of cells T is built on, returns log(theta) (see
+ * tilt.h); only the row-scaled tables are tilted */
+inline double table_tilt(const double *pi,size_t q,size_t r,std::vector<double> &p,const double *) {
+  double logtheta=tilt(pi,q,r);
+  p.resize(q);
+  for (size_t i=0; i<q; i++)
+    p[i]=tilted(pi[i],logtheta);
+  return logtheta;
+};
+
+inline double table_tilt(const double *pi,size_t q,size_t,std::vector<double> &p,const xdouble *) {
+  p.assign(pi,pi+q);
+  return 0.0;
+};
+
+template <class T>
+double table_pi(const double *pi,size_t q,size_t r,std::vector<double> &p) {
+  return table_tilt(pi,q,r,p,(const T *)0);
+};
+
+inline double todouble(double x) { return x; };
+inline double todouble(const xdouble &x) { return x.to_double(); };
+
+/* drop the cells at both ends of row[lo..hi] that are below tol times the
+ * largest cell (rows are unimodal in m), return the fraction of the row
+ * total that was dropped */
+template <class T>
+double trim_row(T *row,size_t &lo,size_t &hi,double tol) {
+  T largest=0.0,total=0.0,dropped=0.0;
+  for (size_t m=lo; m<=hi; m++) {
+    total+=row[m];
+    if (largest<row[m])
+      largest=row[m];
+  }
+  T bound=largest*tol;
+  while (lo<hi && row[lo]<bound) {
+    dropped+=row[lo];
+    lo++;
+  }
+  while (hi>lo && row[hi]<bound) {
+    dropped+=row[hi];
+    hi--;
+  }
+  if (!(total>0.0))
+    return 0.0;
+  return todouble(dropped/total);
+};
+
+/* compute row i of the table (D, position cur) from row i+1 (S, position prev).
+ * Only the band D.lo(cur) ... D.hi(cur) is computed: B_i[m] is zero for
+ * m<r-(q-1-i) and never used for m>i+1 since at most i cases precede i.
+ * The cells just outside the band are set to zero, nothing further is read.
+ * With tol>0 the band is also trimmed (see trim_row), the dropped fraction is
+ * added to *discarded. */
+template <class T>
+void backward_step(btable<T> &D,size_t cur,btable<T> &S,size_t prev,size_t i,double p,double tol,double *discarded) {
+  size_t lo=S.lo(prev)>0 ? S.lo(prev)-1 : 0;
+  size_t hi=S.hi(prev)<i+1 ? S.hi(prev) : i+1;
+  T *row=D[cur];
+  D.scale(cur)=S.scale(prev)+backward_row(row,S[prev],p,lo,hi);
+  if (tol>0.0) {
+    double d=trim_row(row,lo,hi,tol);
+    if (discarded)
+      *discarded+=d;
+  }
+  if (lo>0)
+    row[lo-1]=0.0;
+  row[hi+1]=0.0;
+  D.lo(cur)=lo;
+  D.hi(cur)=hi;
+};
+
+/* set row i of B to B_{q-1}: 1 for m=r, 0 elsewhere */
+template <class T>
+void backward_init(btable<T> &B,size_t i,size_t r) {
+  T *row=B[i];
+  for (size_t m=0; m<=r+1; m++)
+    row[m]=0.0;
+  row[r]=1.0;
+  B.scale(i)=0;
+  B.lo(i)=r;
+  B.hi(i)=r;
+};
+
+/* P(case) for individual i given N previous cases, from row `row` alone */
+inline double split(btable<xdouble> &B,size_t row,size_t N,double p) {
+  xdouble prob0=(1.0-p)*B[row][N];
+  xdouble prob1=p*B[row][N+1];
+  return (prob1/(prob0+prob1)).to_double();
+};
+
+inline double split(btable<double> &B,size_t row,size_t N,double p) {
+  double prob0=(1.0-p)*B[row][N];
+  double prob1=p*B[row][N+1];
+  if (!(prob0+prob1>0.0))
+    throw std::range_error("row-scaled backward table underflow, use numeric=\"xdouble\"");
+  return prob1/(prob0+prob1);
+};
+
+/* P(case) for individual i given N previous cases, from rows cur=i and prev=i-1 */
+inline double step(btable<xdouble> &B,size_t cur,size_t prev,size_t N,double p) {
+  return (p*B[cur][N+1]/B[prev][N]).to_double();
+};
+
+inline double step(btable<double> &B,size_t cur,size_t prev,size_t N,double p) {
+  if (!(B[prev][N]>0.0))
+    throw std::range_error("row-scaled backward table underflow, use numeric=\"xdouble\"");
+  return ldexp(p*B[cur][N+1]/B[prev][N],(int)(B.scale(cur)-B.scale(prev)));
+};
+
+/* compute backward quantities B_j ... B_{j+h-1} in a circular buffer of h rows
+ * (B_i[m] = P(cases among i+1..q-1 = r-m)), return the position of B_j */
+template <class T>
+size_t backward(size_t r,size_t h,size_t j,const double *pi,size_t q,btable<T> &B,double tol=0.0,double *discarded=0) {
+  size_t currentpos,previouspos;
+  currentpos=h-1;
+
+  // initialize B
+  backward_init(B,h-1,r);
+
+  for (size_t i=q-2; i!=j-1; i--) {
+    // update circular positions
+    previouspos=currentpos;
+    currentpos--;
+    if (currentpos==(size_t)-1)
+      currentpos+=h;
+    // update B
+    backward_step(B,currentpos,B,previouspos,i,pi[i+1],tol,discarded);
+  }
+  return currentpos;
+};
+
+/* draw one configuration from a complete (h=q) backward table */
+template <class T,class RNG>
+void forward(const double *pi,size_t q,btable<T> &B,int *res,RNG &g) {
+  size_t N=0;
+
+  //sample res[0]
+  res[0]=draw(g,split(B,0,0,pi[0]));
+  if (res[0])
+    N++;
+
+  // row i-1 is B_{i-1}, row i is B_i
+  for (size_t i=1; i<q; i++) {
+    res[i]=draw(g,step(B,i,i-1,N,pi[i]));
+    if (res[i])
+      N++;
+  }
+};
+
+/* copy row j of S (band, guard cells and exponent) into row i of D */
+template <class T>
+void copy_row(btable<T> &D,size_t i,btable<T> &S,size_t j) {
+  size_t lo=S.lo(j),hi=S.hi(j);
+  T *to=D[i];
+  const T *from=S[j];
+  for (size_t m=(lo>0 ? lo-1 : 0); m<=hi+1; m++)
+    to[m]=from[m];
+  D.scale(i)=S.scale(j);
+  D.lo(i)=lo;
+  D.hi(i)=hi;
+};
+
+/* backward sweep of the checkpointed table: B_i in row i/k of C for every i
+ * multiple of k, rows 0 and 1 of S as a rolling buffer */
+template <class T>
+void backward_checkpoints(size_t r,size_t k,const double *pi,size_t q,btable<T> &C,btable<T> &S,double tol=0.0,double *discarded=0) {
+  size_t cur=0,prev;
+  backward_init(S,cur,r);
+  if ((q-1)%k==0)
+    copy_row(C,(q-1)/k,S,cur);
+  for (size_t i=q-1; i-- >0; ) {
+    prev=cur;
+    cur=1-cur;
+    backward_step(S,cur,S,prev,i,pi[i+1],tol,discarded);
+    if (i%k==0)
+      copy_row(C,i/k,S,cur);
+  }
+};
+
+/* regenerate B_{sk} ... B_{sk+len-1} (segment s) in rows 0 ... len-1 of S
+ * from checkpoint s+1 of C, return len */
+template <class T>
+size_t backward_segment(size_t r,size_t s,size_t k,const double *pi,size_t q,btable<T> &C,btable<T> &S,double tol=0.0) {
+  size_t first=s*k;
+  size_t len=(first+k<=q) ? k : q-first;
+  if (first+len==q)
+    backward_init(S,len-1,r);
+  else
+    backward_step(S,len-1,C,s+1,first+len-1,pi[first+len],tol,0);
+  for (size_t l=len-1; l-- >0; )
+    backward_step(S,l,S,l+1,first+l,pi[first+l+1],tol,0);
+  return len;
+};
+
+/* draw one configuration with a checkpointed backward table: a single
+ * backward sweep keeps B_i for every i multiple of k, then the rows of each
+ * segment B_{sk} ... B_{sk+k-1} are regenerated from the next checkpoint
+ * when the forward sampling reaches it. Time is twice a full backward pass,
+ * memory is ceil(q/k)+k rows instead of q. */
+template <class T,class RNG>
+void forward_checkpoint(size_t r,size_t k,const double *ppi,size_t q,int *res,RNG &g,double tol=0.0,double *discarded=0) {
+  std::vector<double> p;
+  table_pi<T>(ppi,q,r,p);
+  const double *pi=q>0 ? &p[0] : ppi;
+  size_t nck=(q+k-1)/k;
+  btable<T> C(nck,r+2),S(k<2 ? 2 : k,r+2);
+  backward_checkpoints(r,k,pi,q,C,S,tol,discarded);
+
+  size_t N=0;
+  for (size_t s=0; s<nck; s++) {
+    size_t first=s*k;
+    size_t len=backward_segment(r,s,k,pi,q,C,S,tol);
+
+    // sample the segment
+    res[first]=draw(g,split(S,0,N,pi[first]));
+    if (res[first])
+      N++;
+    for (size_t l=1; l<len; l++) {
+      res[first+l]=draw(g,step(S,l,l-1,N,pi[first+l]));
+      if (res[first+l])
+	N++;
+    }
+  }
+};
+
+/* segment length for a backward table of q rows of r+2 cells of type T
+ * within budget bytes (budget<=0: no limit): q when the whole table fits,
+ * about sqrt(q) for the checkpointed version, 0 if nothing fits */
+template <class T>
+size_t segment_length(size_t q,size_t r,double budget) {
+  double row=(double)btable<T>::rowbytes(r+2);
+  if (budget<=0.0 || (double)q*row<=budget)
+    return q;
+  size_t k=(size_t)ceil(sqrt((double)q));
+  if ((double)((q+k-1)/k+k)*row>budget)
+    return 0;
+  return k;
+};
+
+/* draw one configuration, keeping the backward table within budget bytes,
+ * with tol>0 the rows are truncated and the sum over rows of the discarded
+ * fractions is returned */
+template <class T,class RNG>
+double forward_budget(size_t r,double budget,const double *pi,size_t q,int *res,RNG &g,double tol=0.0) {
+  if (r>q)
+    throw std::invalid_argument("more cases than individuals");
+  size_t k=segment_length<T>(q,r,budget);
+  if (k==0)
+    throw std::length_error("memory budget too small for the checkpointed backward table");
+  double discarded=0.0;
+  if (k==q) {
+    std::vector<double> p;
+    table_pi<T>(pi,q,r,p);
+    btable<T> B(q,r+2);
+    backward(r,q,0,&p[0],q,B,tol,&discarded);
+    forward(&p[0],q,B,res,g);
+  } else {
+    forward_checkpoint<T>(r,k,pi,q,res,g,tol,&discarded);
+  }
+  return discarded;
+};
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _waffect_BTABLE_H
+#define _waffect_BTABLE_H
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace waffect {
+
+/* backward table: h rows of (at least) r+2 cells stored in a single
+ * buffer aligned on a cache line, each row starting on a cache line.
+ * B[i] is a pointer to row i, B[i][m] the cell (i,m). Each row also has
+ * a binary exponent B.scale(i), only used by row-scaled tables, and a band
+ * B.lo(i) ... B.hi(i) outside which the cells are zero. */
+template <class T>
+class btable {
+private:
+  void *mem;
+  T *data;
+  size_t h,width,stride;
+  std::vector<long> e;
+  std::vector<size_t> l,u;
+
+  btable(const btable &);            // not copyable
+  btable &operator=(const btable &);
+
+public:
+  static const size_t align=64;
+
+  /* bytes used by one row of ww cells */
+  static size_t rowbytes(size_t ww) {
+    size_t per=align/sizeof(T);
+    return (ww+per-1)/per*per*sizeof(T);
+  }
+
+  btable() : mem(0), data(0), h(0), width(0), stride(0) {}
+  btable(size_t hh,size_t ww) : mem(0), data(0), h(0), width(0), stride(0) { resize(hh,ww); }
+  ~btable() { std::free(mem); }
+
+  /* (re)allocate hh rows of ww cells, all set to zero */
+  void resize(size_t hh,size_t ww) {
+    std::free(mem);
+    mem=0; data=0;
+    h=hh; width=ww;
+    e.assign(h,0);
+    l.assign(h,0);
+    u.assign(h,ww>1 ? ww-2 : 0);
+    size_t per=align/sizeof(T);
+    stride=(ww+per-1)/per*per;
+    if (h*stride==0)
+      return;
+    mem=std::malloc(h*stride*sizeof(T)+align);
+    if (!mem)
+      throw std::bad_alloc();
+    size_t addr=reinterpret_cast<size_t>(mem);
+    data=reinterpret_cast<T *>((addr+align-1)/align*align);
+    for (size_t k=0; k<h*stride; k++)
+      new (data+k) T();
+  }
+
+  T *operator[](size_t i) { return data+i*stride; }
+  const T *operator[](size_t i) const { return data+i*stride; }
+  long &scale(size_t i) { return e[i]; }
+  long scale(size_t i) const { return e[i]; }
+  size_t &lo(size_t i) { return l[i]; }
+  size_t &hi(size_t i) { return u[i]; }
+
+  size_t nrow() const { return h; }
+  size_t ncol() const { return width; }
+  size_t rowstride() const { return stride; }
+  size_t bytes() const { return h*stride*sizeof(T); }
+};
+
+}
+
+#endif
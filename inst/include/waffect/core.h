@@ -0,0 +1,157 @@
+#ifndef _waffect_CORE_H
+#define _waffect_CORE_H
+
+/*
+ * Header-only interface of the samplers, independent of R and Rcpp:
+ *
+ *   #include <waffect/core.h>
+ *   std::vector<double> pi = ...;
+ *   std::vector<int> y(pi.size());
+ *   waffect::philox g(seed);
+ *   waffect::sample(pi, r, y, g);               // backward sampling
+ *   waffect::sample(pi, r, y, g, waffect::options(waffect::FFT));
+ *
+ * Inputs and outputs are contiguous ranges (std::vector, std::array,
+ * std::span, C arrays, Rcpp vectors ...): anything with begin() and size().
+ * Outputs of another element type than int go through a temporary buffer.
+ * Any generator with unif() and index(n) can be passed (see rng.h). Errors
+ * are reported by std::invalid_argument, std::length_error (memory budget)
+ * and std::range_error (underflow).
+ */
+
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
+#include "xdouble.h"
+#include "btable.h"
+#include "kernel.h"
+#include "rng.h"
+#include "backward.h"
+#include "mcmc.h"
+#include "mchain.h"
+#include "reject.h"
+#include "ptree.h"
+#include "grouped.h"
+#include "planner.h"
+#include "multiclass.h"
+#include "sampler.h"
+#include "generator.h"
+#include "packed.h"
+#include "store.h"
+#include "model.h"
+#include "marginal.h"
+
+namespace waffect {
+
+/* default options of a method: exact xdouble backward table without budget,
+ * automatic burn-in and uniform proposals for mcmc */
+inline binopt options(int m=BACKWARD) {
+  binopt opt;
+  opt.method=m;
+  opt.scaled=false;
+  opt.budget=0.0;
+  opt.tol=0.0;
+  opt.burnin=0;
+  opt.weighted=false;
+  return opt;
+};
+
+/* first element of a contiguous range (0 if empty) */
+template <class R>
+inline auto data(R &x) -> decltype(&*std::begin(x)) {
+  return std::begin(x)==std::end(x) ? 0 : &*std::begin(x);
+};
+
+template <class R>
+inline size_t size(const R &x) {
+  return (size_t)std::distance(std::begin(x),std::end(x));
+};
+
+/* call f(int *) on the n first elements of out */
+template <class F>
+inline void write(int *out,size_t,F f) {
+  f(out);
+};
+
+template <class T,class F>
+inline void write(T *out,size_t n,F f) {
+  std::vector<int> tmp(n);
+  f(n>0 ? &tmp[0] : 0);
+  std::copy(tmp.begin(),tmp.end(),out);
+};
+
+template <class R,class F>
+inline void output(R &out,size_t n,F f) {
+  if (waffect::size(out)<n)
+    throw std::invalid_argument("output range too short");
+  write(waffect::data(out),n,f);
+};
+
+/* contiguous doubles of a range, converted if necessary */
+inline const double *input(const double *x,size_t,std::vector<double> &) { return x; };
+
+template <class T>
+inline const double *input(const T *x,size_t n,std::vector<double> &tmp) {
+  tmp.assign(x,x+n);
+  return n>0 ? &tmp[0] : 0;
+};
+
+/* one binary configuration with r cases: res[i] in {0,1}, returns the mass
+ * discarded by the truncation of the backward table (opt.tol>0) */
+template <class PI,class OUT,class RNG>
+double sample(const PI &pi,size_t r,OUT &res,RNG &g,const binopt &opt=options()) {
+  std::vector<double> tmp;
+  size_t q=waffect::size(pi);
+  const double *p=input(waffect::data(pi),q,tmp);
+  double discarded=0.0;
+  output(res,q,[&](int *y) { discarded=binary(p,q,r,y,g,opt); });
+  return discarded;
+};
+
+/* one configuration of K classes: prob is K x n (column major), count[k]
+ * individuals in class k+1, cls[j] in 1..K */
+template <class PROB,class COUNT,class OUT,class RNG>
+double sample_multiclass(const PROB &prob,size_t K,const COUNT &count,OUT &cls,RNG &g,const binopt &opt=options()) {
+  std::vector<double> tmp;
+  size_t n=K>0 ? waffect::size(prob)/K : 0;
+  const double *p=input(waffect::data(prob),waffect::size(prob),tmp);
+  std::vector<int> c(std::begin(count),std::end(count));
+  if (c.size()!=K)
+    throw std::invalid_argument("one count per class is needed");
+  double discarded=0.0;
+  output(cls,n,[&](int *y) { discarded=multiclass(p,K,n,&c[0],y,g,opt); });
+  return discarded;
+};
+
+/* exact P(res[j]=1 | r cases) for every j, without sampling, returns
+ * log P(r cases) */
+template <class PI,class OUT>
+double marginals(const PI &pi,size_t r,OUT &res,bool scaled=false,double budget=0.0) {
+  std::vector<double> tmp,m;
+  size_t q=waffect::size(pi);
+  const double *p=input(waffect::data(pi),q,tmp);
+  if (waffect::size(res)<q)
+    throw std::invalid_argument("output range too short");
+  m.resize(q);
+  double logp=scaled ? waffect::marginals<double>(r,p,q,q>0 ? &m[0] : 0,budget) : waffect::marginals<xdouble>(r,p,q,q>0 ? &m[0] : 0,budget);
+  std::copy(m.begin(),m.end(),std::begin(res));
+  return logp;
+};
+
+/* nsim binary configurations (res: q x nsim, column major) from one backward
+ * table, on nthreads threads, configuration k from stream k of seed */
+template <class PI,class OUT>
+double sample_batch(const PI &pi,size_t r,OUT &res,size_t nsim,uint64_t seed,int nthreads=1,bool scaled=false,double tol=0.0) {
+  std::vector<double> tmp;
+  size_t q=waffect::size(pi);
+  const double *p=input(waffect::data(pi),q,tmp);
+  sampler s(p,q,r,scaled,tol);
+  output(res,q*nsim,[&](int *y) { s.batch(y,nsim,seed,nthreads); });
+  return s.discarded;
+};
+
+}
+
+#endif
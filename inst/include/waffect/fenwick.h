@@ -0,0 +1,74 @@
+#ifndef _waffect_FENWICK_H
+#define _waffect_FENWICK_H
+
+#include <vector>
+
+namespace waffect {
+
+/* Fenwick (binary indexed) tree of n non negative weights: O(log n) update
+ * of a weight and O(log n) selection of an index with probability
+ * proportional to its weight */
+class fenwick {
+private:
+  std::vector<double> t;   // t[k] = sum of w[k-lowbit(k) ... k-1] (1-based)
+  std::vector<double> w;
+  size_t top;              // largest power of two <= n
+
+public:
+  fenwick(size_t n=0) { resize(n); }
+
+  void resize(size_t n) {
+    t.assign(n+1,0.0);
+    w.assign(n,0.0);
+    for (top=1; top*2<=n; top*=2) ;
+  }
+
+  size_t size() const { return w.size(); }
+  double operator[](size_t i) const { return w[i]; }
+
+  /* set all the weights at once, O(n) */
+  void assign(const double *x) {
+    size_t n=w.size();
+    for (size_t i=0; i<n; i++) {
+      w[i]=x[i];
+      t[i+1]=x[i];
+    }
+    t[0]=0.0;
+    for (size_t k=1; k<=n; k++) {
+      size_t p=k+(k&(-k));
+      if (p<=n)
+	t[p]+=t[k];
+    }
+  }
+
+  void set(size_t i,double x) {
+    double d=x-w[i];
+    w[i]=x;
+    for (size_t k=i+1; k<t.size(); k+=k&(-k))
+      t[k]+=d;
+  }
+
+  double total() const {
+    double s=0.0;
+    for (size_t k=w.size(); k>0; k-=k&(-k))
+      s+=t[k];
+    return s;
+  }
+
+  /* smallest i with w[0]+...+w[i] > u, for 0<=u<total() (the result may
+   * have a zero weight through round-off, callers check it) */
+  size_t find(double u) const {
+    size_t pos=0,n=w.size();
+    for (size_t step=top; step>0; step>>=1) {
+      if (pos+step<=n && t[pos+step]<=u) {
+	pos+=step;
+	u-=t[pos];
+      }
+    }
+    return pos<n ? pos : n-1;
+  }
+};
+
+}
+
+#endif
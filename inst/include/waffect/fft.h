@@ -0,0 +1,74 @@
+#ifndef _waffect_FFT_H
+#define _waffect_FFT_H
+
+#include <complex>
+#include <vector>
+#include <cmath>
+
+namespace waffect {
+
+/* in place radix-2 complex FFT of size n (a power of two); inverse=true
+ * computes the unnormalized inverse transform */
+inline void fft(std::vector<std::complex<double> > &a,bool inverse) {
+  size_t n=a.size();
+  // bit reversal permutation
+  for (size_t i=1,j=0; i<n; i++) {
+    size_t bit=n>>1;
+    for (; j&bit; bit>>=1)
+      j^=bit;
+    j^=bit;
+    if (i<j)
+      std::swap(a[i],a[j]);
+  }
+  for (size_t len=2; len<=n; len<<=1) {
+    double ang=2.0*M_PI/(double)len*(inverse ? 1.0 : -1.0);
+    size_t half=len>>1;
+    // twiddle factors computed directly (no recurrence) for accuracy
+    std::vector<std::complex<double> > w(half);
+    for (size_t k=0; k<half; k++)
+      w[k]=std::complex<double>(cos(ang*(double)k),sin(ang*(double)k));
+    for (size_t i=0; i<n; i+=len)
+      for (size_t k=0; k<half; k++) {
+	std::complex<double> u=a[i+k],v=a[i+k+half]*w[k];
+	a[i+k]=u+v;
+	a[i+k+half]=u-v;
+      }
+  }
+};
+
+/* c[0..nc-1] = first nc coefficients of the product of the polynomials
+ * a[0..na-1] and b[0..nb-1]; direct product for small sizes, FFT otherwise.
+ * Negative round-off values of the FFT are set to zero. */
+inline void convolve(const double *a,size_t na,const double *b,size_t nb,double *c,size_t nc) {
+  for (size_t k=0; k<nc; k++)
+    c[k]=0.0;
+  if (na==0 || nb==0)
+    return;
+  if (na<=32 || nb<=32 || na*nb<=4096) {
+    for (size_t i=0; i<na && i<nc; i++)
+      for (size_t j=0; j<nb && i+j<nc; j++)
+	c[i+j]+=a[i]*b[j];
+    return;
+  }
+  size_t n=1;
+  while (n<na+nb-1)
+    n<<=1;
+  std::vector<std::complex<double> > fa(n),fb(n);
+  for (size_t i=0; i<na; i++)
+    fa[i]=a[i];
+  for (size_t i=0; i<nb; i++)
+    fb[i]=b[i];
+  fft(fa,false);
+  fft(fb,false);
+  for (size_t i=0; i<n; i++)
+    fa[i]*=fb[i];
+  fft(fa,true);
+  for (size_t k=0; k<nc && k<na+nb-1; k++) {
+    double x=fa[k].real()/(double)n;
+    c[k]=x>0.0 ? x : 0.0;
+  }
+};
+
+}
+
+#endif
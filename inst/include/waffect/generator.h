@@ -0,0 +1,225 @@
+#ifndef _waffect_GENERATOR_H
+#define _waffect_GENERATOR_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <stdint.h>
+#include "xdouble.h"
+#include "btable.h"
+#include "rng.h"
+#include "backward.h"
+#include "reject.h"
+#include "ptree.h"
+#include "grouped.h"
+#include "planner.h"
+#include "multiclass.h"
+#include "sampler.h"
+#include "packed.h"
+
+namespace waffect {
+
+/*
+ * Exact binary engine prepared once for (pi,r) and shared by many
+ * replicates: the backward table (if it fits within the budget), the product
+ * tree or the groups. Replicate k is drawn from stream k of the seed, as in
+ * sampler::batch, so that it does not depend on the order of the draws nor on
+ * the number of threads. method is a binopt code except mcmc; auto is
+ * resolved by the planner with scaled tables, and a replicate on which the
+ * chosen engine underflows is drawn again from the xdouble table. update
+ * changes some pi between draws, in O(k log q) node products with the
+ * product tree (FFT).
+ */
+class generator {
+  std::vector<double> pi;
+  size_t q,r;
+  bool scaled;
+  double budget;
+  bool automatic;
+  std::unique_ptr<sampler> S,X;
+  std::unique_ptr<ptree> T;
+  std::unique_ptr<grouped> G;
+
+  /* the whole backward table of cell type T fits within the budget */
+  template <class C>
+  bool fits() const {
+    return budget<=0.0 || (double)q*btable<C>::rowbytes(r+2)<=budget;
+  }
+
+  /* xdouble table of auto, built at the first underflow (null if it does
+   * not fit within the budget: checkpoints for each replicate) */
+  sampler *exact() {
+    sampler *x=0;
+    bool failed=false;
+#ifdef _OPENMP
+#pragma omp critical(waffect_generator_exact)
+#endif
+    {
+      try {
+	if (!X && fits<xdouble>())
+	  X.reset(new sampler(&pi[0],q,r,false,0.0));
+      } catch (std::bad_alloc &) {
+	failed=true;
+      }
+      x=X.get();
+    }
+    if (failed)
+      throw std::bad_alloc();
+    return x;
+  }
+
+  /* replicate k with the engine of method */
+  void replicate(int *res,uint64_t seed,uint64_t k,std::vector<size_t> &work) {
+    philox g(seed,k);
+    if (S)
+      S->sample(res,g);
+    else if (T)
+      T->sample(res,seed,k,work);
+    else if (G)
+      G->sample(res,g,work);
+    else if (method==REJECT)
+      reject(&pi[0],q,r,res,g);
+    else if (scaled)
+      forward_budget<double>(r,budget,&pi[0],q,res,g);
+    else
+      forward_budget<xdouble>(r,budget,&pi[0],q,res,g);
+  }
+
+public:
+  int method;
+
+  generator(const double *ppi,size_t qq,size_t rr,int m,bool sscaled,double bbudget,size_t nsim=1,int nthreads=1) : pi(ppi,ppi+qq), q(qq), r(rr), scaled(sscaled), budget(bbudget), automatic(m==AUTO), method(m) {
+    if (r>q)
+      throw std::invalid_argument("more cases than individuals");
+    if (automatic) {
+      method=plan_method(make_plan(&pi[0],q,r,nsim,budget).engine);
+      scaled=true;
+    }
+    prepare(nthreads);
+  }
+
+  size_t individuals() const { return q; }
+
+  /* the engine of method for the current pi */
+  void prepare(int nthreads=1) {
+    S.reset();
+    X.reset();
+    T.reset();
+    G.reset();
+    switch (method) {
+    case REJECT:
+      break;
+    case FFT:
+      T.reset(new ptree(&pi[0],q,r,nthreads));
+      break;
+    case GROUPED:
+      G.reset(new grouped(&pi[0],q,r));
+      break;
+    case BACKWARD:
+      // the whole table if it fits, checkpoints for each replicate otherwise
+      if (scaled ? fits<double>() : fits<xdouble>())
+	S.reset(new sampler(&pi[0],q,r,scaled,0.0));
+      break;
+    default:
+      throw std::invalid_argument("no prepared engine for this method");
+    }
+  }
+
+  /* pi[idx[j]]=p[j] for j=0 ... k-1: the product tree is updated in place
+   * (ptree::update), the other engines are prepared again. The indices are
+   * checked first: a bad one leaves the generator as it was. */
+  void update(const size_t *idx,const double *p,size_t k,int nthreads=1) {
+    for (size_t j=0; j<k; j++)
+      if (idx[j]>=q)
+	throw std::out_of_range("individual not in the generator");
+    if (T)
+      T->update(idx,p,k,nthreads);
+    for (size_t j=0; j<k; j++)
+      pi[idx[j]]=p[j];
+    if (!T)
+      prepare(nthreads);
+  }
+
+  /* replicate k in res[0 ... q-1], work is a scratch vector of the caller.
+   * Underflow only shows when sampling: with auto, the replicate is then
+   * drawn from the xdouble table, still from stream k. */
+  void sample(int *res,uint64_t seed,uint64_t k,std::vector<size_t> &work) {
+    try {
+      replicate(res,seed,k,work);
+    } catch (std::range_error &) {
+      if (!automatic)
+	throw;
+      philox g(seed,k);
+      sampler *x=exact();
+      if (x)
+	x->sample(res,g);
+      else
+	forward_budget<xdouble>(r,budget,&pi[0],q,res,g);
+    }
+  }
+
+  /* replicates first ... first+nsim-1 in the columns of res, on nthreads
+   * threads */
+  void block(int *res,size_t first,size_t nsim,uint64_t seed,int nthreads) {
+    bool failed=false;
+    std::string what;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic,1)
+#endif
+    for (long k=0; k<(long)nsim; k++) {
+      std::vector<size_t> work;
+      try {
+	sample(res+k*q,seed,first+k,work);
+      } catch (std::exception &e) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+	{
+	  failed=true;
+	  what=e.what();
+	}
+      }
+    }
+    if (failed)
+      throw std::range_error(what);
+  }
+
+  /* replicates first ... first+nsim-1 bit-packed (packed.h) in the columns
+   * of res, each drawn in a buffer of q ints per thread */
+  void block_packed(unsigned char *res,size_t first,size_t nsim,uint64_t seed,int nthreads) {
+    size_t nbytes=packed_bytes(q);
+    bool failed=false;
+    std::string what;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+    {
+      std::vector<int> y(q+1);
+      std::vector<size_t> work;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic,1)
+#endif
+      for (long k=0; k<(long)nsim; k++) {
+	try {
+	  sample(&y[0],seed,first+k,work);
+	  pack(&y[0],q,res+k*nbytes);
+	} catch (std::exception &e) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+	  {
+	    failed=true;
+	    what=e.what();
+	  }
+	}
+      }
+    }
+    if (failed)
+      throw std::range_error(what);
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef _waffect_GROUPED_H
+#define _waffect_GROUPED_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "fft.h"
+#include "tilt.h"
+#include "rng.h"
+
+namespace waffect {
+
+/*
+ * Sampler for models with few distinct probabilities. The individuals with
+ * the same pi form a group; given the number of cases, the cases of a group
+ * are a uniform subset of it. The number of cases k_g of each group is drawn
+ * from a backward table over the G groups (P[g] is the distribution of the
+ * number of cases in groups g..G-1, truncated to r cases, the product of the
+ * Binomial(n_g,pi_g)), then k_g individuals of group g are chosen uniformly.
+ * The individuals with pi=0 or pi=1 are controls or cases, outside of any
+ * group. Building costs O(G r log r), each draw O(G r+n).
+ *
+ * As in ptree.h, the probabilities are tilted so that the expected number of
+ * cases is r and each row is divided by its largest entry; entries below
+ * about 1e-16 times the largest one are not accurate.
+ */
+class grouped {
+public:
+  size_t q,r;                    // r: cases among the groups
+  std::vector<size_t> ones;      // individuals with pi=1
+  std::vector<size_t> member;    // members of group g: member[first[g] ... first[g+1]-1]
+  std::vector<size_t> first;
+  std::vector<double> prob;      // pi of group g
+  std::vector<std::vector<double> > binom,P;
+
+  grouped(const double *pi,size_t qq,size_t rr) : q(qq) {
+    if (rr>q)
+      throw std::invalid_argument("more cases than individuals");
+    std::vector<size_t> order;
+    for (size_t i=0; i<q; i++) {
+      if (pi[i]>=1.0)
+	ones.push_back(i);
+      else if (pi[i]>0.0)
+	order.push_back(i);
+    }
+    if (rr<ones.size() || rr>ones.size()+order.size())
+      throw std::invalid_argument("the number of cases is not compatible with the probabilities");
+    r=rr-ones.size();
+
+    // groups of equal pi (exact comparison), members in increasing order
+    std::stable_sort(order.begin(),order.end(),byprob(pi));
+    for (size_t t=0; t<order.size(); t++) {
+      if (t==0 || pi[order[t]]!=pi[order[t-1]]) {
+	first.push_back(t);
+	prob.push_back(pi[order[t]]);
+      }
+      member.push_back(order[t]);
+    }
+    first.push_back(member.size());
+    size_t G=prob.size();
+
+    std::vector<size_t> size(G);
+    for (size_t g=0; g<G; g++)
+      size[g]=first[g+1]-first[g];
+    double logtheta=G>0 ? tilt(&prob[0],&size[0],G,r) : 0.0;
+
+    // binomial distributions of the tilted groups, truncated to r cases
+    binom.resize(G);
+    for (size_t g=0; g<G; g++) {
+      double p=tilted(prob[g],logtheta);
+      size_t n=size[g],K=n<r ? n : r;
+      std::vector<double> &b=binom[g];
+      b.resize(K+1);
+      double lp=log(p),lq=log1p(-p),lgn=lgamma((double)n+1.0),m=-HUGE_VAL;
+      for (size_t k=0; k<=K; k++) {
+	b[k]=lgn-lgamma((double)k+1.0)-lgamma((double)(n-k)+1.0)+(double)k*lp+(double)(n-k)*lq;
+	if (m<b[k])
+	  m=b[k];
+      }
+      for (size_t k=0; k<=K; k++)
+	b[k]=exp(b[k]-m);
+    }
+
+    // P[G]=1 (no case), P[g]=binom[g]*P[g+1]
+    P.resize(G+1);
+    P[G].assign(1,1.0);
+    for (size_t g=G; g-- >0; ) {
+      size_t n=binom[g].size()+P[g+1].size()-1;
+      P[g].resize(n<r+1 ? n : r+1);
+      convolve(&binom[g][0],binom[g].size(),&P[g+1][0],P[g+1].size(),&P[g][0],P[g].size());
+      double m=0.0;
+      for (size_t k=0; k<P[g].size(); k++)
+	if (m<P[g][k])
+	  m=P[g][k];
+      if (m>0.0)
+	for (size_t k=0; k<P[g].size(); k++)
+	  P[g][k]/=m;
+    }
+    if (P[0].size()<r+1 || !(P[0][r]>0.0))
+      throw std::invalid_argument("the number of cases is not compatible with the probabilities");
+  }
+
+  struct byprob {
+    const double *pi;
+    byprob(const double *ppi) : pi(ppi) {}
+    bool operator()(size_t i,size_t j) const { return pi[i]<pi[j]; }
+  };
+
+  size_t ngroups() const { return prob.size(); }
+
+  /* draw one configuration, work is a scratch vector */
+  template <class RNG>
+  void sample(int *res,RNG &g,std::vector<size_t> &work) const {
+    for (size_t i=0; i<q; i++)
+      res[i]=0;
+    for (size_t t=0; t<ones.size(); t++)
+      res[ones[t]]=1;
+
+    size_t left=r;
+    for (size_t h=0; h<prob.size(); h++) {
+      // number of cases of group h given left cases in groups h..G-1
+      const std::vector<double> &b=binom[h],&next=P[h+1];
+      size_t kmin=left>next.size()-1 ? left-(next.size()-1) : 0;
+      size_t kmax=left<b.size()-1 ? left : b.size()-1;
+      double total=0.0;
+      for (size_t k=kmin; k<=kmax; k++)
+	total+=b[k]*next[left-k];
+      if (!(total>0.0))
+	throw std::range_error("grouped sampler underflow");
+      double x=g.unif()*total;
+      size_t k=kmin;
+      for (; k<kmax; k++) {
+	x-=b[k]*next[left-k];
+	if (x<0.0)
+	  break;
+      }
+      left-=k;
+
+      // k uniform cases among the n members (partial Fisher-Yates on the
+      // smaller of the two sides)
+      size_t n=first[h+1]-first[h];
+      const size_t *m=&member[first[h]];
+      bool fewcases=2*k<=n;
+      size_t pick=fewcases ? k : n-k;
+      if (!fewcases)
+	for (size_t t=0; t<n; t++)
+	  res[m[t]]=1;
+      work.assign(m,m+n);
+      for (size_t t=0; t<pick; t++) {
+	size_t u=t+g.index(n-t);
+	std::swap(work[t],work[u]);
+	res[work[t]]=fewcases ? 1 : 0;
+      }
+    }
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef _waffect_KERNEL_H
+#define _waffect_KERNEL_H
+
+#include <cstddef>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define WAFFECT_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace waffect {
+
+inline double kernel_scalar(double *cur,const double *prev,double p,size_t lo,size_t hi) {
+  double p1=p,p0=1.0-p;
+  double largest=0.0;
+  for (size_t m=lo; m<=hi; m++) {
+    cur[m]=std::fma(p1,prev[m+1],p0*prev[m]);
+    largest=cur[m]>largest ? cur[m] : largest;
+  }
+  return largest;
+}
+
+#ifdef WAFFECT_X86_DISPATCH
+
+__attribute__((target("avx2,fma")))
+inline double kernel_avx2(double *cur,const double *prev,double p,size_t lo,size_t hi) {
+  double p1=p,p0=1.0-p;
+  __m256d vp1=_mm256_set1_pd(p1),vp0=_mm256_set1_pd(p0);
+  __m256d vmax=_mm256_setzero_pd();
+  size_t m=lo;
+  for (; m+4<=hi+1; m+=4) {
+    __m256d a=_mm256_loadu_pd(prev+m+1);
+    __m256d b=_mm256_mul_pd(vp0,_mm256_loadu_pd(prev+m));
+    __m256d c=_mm256_fmadd_pd(vp1,a,b);
+    _mm256_storeu_pd(cur+m,c);
+    vmax=_mm256_max_pd(vmax,c);
+  }
+  double tmp[4];
+  _mm256_storeu_pd(tmp,vmax);
+  double largest=tmp[0];
+  for (int k=1; k<4; k++)
+    largest=tmp[k]>largest ? tmp[k] : largest;
+  for (; m<=hi; m++) {
+    cur[m]=std::fma(p1,prev[m+1],p0*prev[m]);
+    largest=cur[m]>largest ? cur[m] : largest;
+  }
+  return largest;
+}
+
+__attribute__((target("avx512f")))
+inline double kernel_avx512(double *cur,const double *prev,double p,size_t lo,size_t hi) {
+  double p1=p,p0=1.0-p;
+  __m512d vp1=_mm512_set1_pd(p1),vp0=_mm512_set1_pd(p0);
+  __m512d vmax=_mm512_setzero_pd();
+  size_t m=lo;
+  for (; m+8<=hi+1; m+=8) {
+    __m512d a=_mm512_loadu_pd(prev+m+1);
+    __m512d b=_mm512_mul_pd(vp0,_mm512_loadu_pd(prev+m));
+    __m512d c=_mm512_fmadd_pd(vp1,a,b);
+    _mm512_storeu_pd(cur+m,c);
+    vmax=_mm512_mask_mov_pd(vmax,_mm512_cmp_pd_mask(c,vmax,_CMP_GT_OQ),c);
+  }
+  double tmp[8];
+  _mm512_storeu_pd(tmp,vmax);
+  double largest=tmp[0];
+  for (int k=1; k<8; k++)
+    largest=tmp[k]>largest ? tmp[k] : largest;
+  for (; m<=hi; m++) {
+    cur[m]=std::fma(p1,prev[m+1],p0*prev[m]);
+    largest=cur[m]>largest ? cur[m] : largest;
+  }
+  return largest;
+}
+
+#endif
+
+typedef double (*kernel_t)(double *,const double *,double,size_t,size_t);
+
+struct kernel_choice {
+  kernel_t kernel;
+  const char *name;
+};
+
+inline kernel_choice select_kernel() {
+  const char *force=getenv("WAFFECT_KERNEL");
+  kernel_choice k={kernel_scalar,"scalar"};
+#ifdef WAFFECT_X86_DISPATCH
+  __builtin_cpu_init();
+  bool avx2=__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  bool avx512=__builtin_cpu_supports("avx512f");
+  if (force && strcmp(force,"scalar")==0)
+    return k;
+  if (avx512 && !(force && strcmp(force,"avx2")==0)) {
+    k.kernel=kernel_avx512;
+    k.name="avx512";
+  } else if (avx2) {
+    k.kernel=kernel_avx2;
+    k.name="avx2";
+  }
+#endif
+  return k;
+};
+
+/* the choice made at the first call, shared by every translation unit */
+inline const kernel_choice &current_kernel() {
+  static const kernel_choice k=select_kernel();
+  return k;
+};
+
+/* backward recursion on double rows:
+ *   cur[m] = fma(p, prev[m+1], (1-p)*prev[m])   for m=lo..hi
+ * returns the largest cur[m] of the range. The AVX-512, AVX2 and scalar
+ * versions perform exactly the same roundings and give identical rows;
+ * the best one supported by the CPU is picked at the first call (the
+ * environment variable WAFFECT_KERNEL=scalar|avx2|avx512 forces a choice). */
+inline double backward_kernel(double *cur,const double *prev,double p,size_t lo,size_t hi) {
+  return current_kernel().kernel(cur,prev,p,lo,hi);
+};
+
+/* name of the kernel in use */
+inline const char *backward_kernel_name() {
+  return current_kernel().name;
+};
+
+}
+
+#endif
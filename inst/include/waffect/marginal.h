@@ -0,0 +1,96 @@
+#ifndef _waffect_MARGINAL_H
+#define _waffect_MARGINAL_H
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include "xdouble.h"
+#include "btable.h"
+#include "backward.h"
+
+namespace waffect {
+
+/*
+ * Exact marginals of the conditional Bernoulli model by a forward-backward
+ * pass: with F_j[m] = P(m cases among 0 ... j-1) and the backward table
+ * B_j[m] = P(r-m cases among j+1 ... q-1),
+ *   P(Y_j=1, sum=r) = pi_j sum_m F_j[m] B_j[m+1]
+ *   P(sum=r)        = sum_m F_j[m] ((1-pi_j) B_j[m] + pi_j B_j[m+1])  (any j)
+ * The forward rows are stored reversed, G_j[r-m] = F_j[m], so that they
+ * follow the recursion of the backward rows (backward_step, with the same
+ * row scaling) and take two rows; the backward table is checkpointed within
+ * the budget as for forward_checkpoint. Row-scaled tables are built on the
+ * tilted pi (table_pi), which leave the marginals unchanged; P(sum=r) is
+ * then corrected by tilt_norm.
+ */
+
+/* log of a cell of a row with exponent scale */
+inline double logcell(double x,long scale) {
+  return log(x)+(double)scale*log(2.0);
+};
+
+inline double logcell(const xdouble &x,long) {
+  return log(x);
+};
+
+/* res[j] = P(Y_j=1 | sum=r) for j=0 ... q-1, returns log P(sum=r) */
+template <class T>
+double marginals(size_t r,const double *ppi,size_t q,double *res,double budget=0.0) {
+  if (r>q)
+    throw std::invalid_argument("more cases than individuals");
+  if (q==0)
+    return 0.0;
+  std::vector<double> tp;
+  double logtheta=table_pi<T>(ppi,q,r,tp);
+  const double *pi=&tp[0];
+  size_t k=segment_length<T>(q,r,budget);
+  if (k==0)
+    throw std::length_error("memory budget too small for the checkpointed backward table");
+  size_t nck=(q+k-1)/k;
+  btable<T> C(k<q ? nck : 0,r+2),S(k<2 ? 2 : k,r+2),F(2,r+2);
+  if (k<q)
+    backward_checkpoints(r,k,pi,q,C,S);
+  else
+    backward(r,q,0,pi,q,S);
+
+  // G_0: no case before individual 0
+  size_t cur=0,prev;
+  backward_init(F,cur,r);
+  double logp=0.0;
+  for (size_t s=0; s<nck; s++) {
+    size_t first=s*k;
+    size_t len=k<q ? backward_segment(r,s,k,pi,q,C,S) : q;
+    for (size_t l=0; l<len; l++) {
+      size_t j=first+l;
+      double p=pi[j];
+      // m within the bands of both rows, the guard cells are zero
+      size_t lo=S.lo(l)>0 ? S.lo(l)-1 : 0;
+      size_t hi=r-F.lo(cur)<S.hi(l) ? r-F.lo(cur) : S.hi(l);
+      const T *G=F[cur],*B=S[l];
+      T num=0.0,den=0.0;
+      for (size_t m=lo; m<=hi; m++) {
+	num+=G[r-m]*B[m+1];
+	den+=G[r-m]*((1.0-p)*B[m]+p*B[m+1]);
+      }
+      if (!(den>0.0)) {
+	if (j>0)
+	  throw std::range_error("row-scaled backward table underflow, use numeric=\"xdouble\"");
+	throw std::invalid_argument("the number of cases has probability zero");
+      }
+      if (j==0)
+	logp=logcell(den,F.scale(cur)+S.scale(l));
+      res[j]=todouble(p*num/den);
+      // G_{j+1} from G_j: the band may reach m=r
+      if (j+1<q) {
+	prev=cur;
+	cur=1-cur;
+	backward_step(F,cur,F,prev,r,p,0.0,0);
+      }
+    }
+  }
+  return logp-(double)r*logtheta+tilt_norm(ppi,q,logtheta);
+};
+
+}
+
+#endif
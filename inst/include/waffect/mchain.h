@@ -0,0 +1,163 @@
+#ifndef _waffect_MCHAIN_H
+#define _waffect_MCHAIN_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include "mcmc.h"
+
+namespace waffect {
+
+/*
+ * Several chains of mcmc.h run in parallel, chain c on stream c of a philox
+ * seed (the result does not depend on the number of threads). The chains
+ * run by sweeps of q steps; after each sweep they report the number of
+ * cases in each of MCHAIN_BINS bins of individuals of increasing pi, and
+ * the Gelman-Rubin potential scale reduction factor (R-hat) of every bin is
+ * computed from the second half of the records. The burn-in stops when all
+ * of them are below MCHAIN_RHAT.
+ */
+
+const size_t MCHAIN_BINS=10;
+const double MCHAIN_RHAT=1.05;
+
+/* R-hat of x[c][first ... first+n-1] over the chains c (1 for a statistic
+ * constant over every chain, infinite if only the chains differ) */
+inline double rhat(const std::vector<std::vector<double> > &x,size_t first,size_t n) {
+  size_t m=x.size();
+  if (m<2 || n<2)
+    return HUGE_VAL;
+  std::vector<double> mean(m,0.0);
+  double all=0.0,W=0.0,B=0.0;
+  for (size_t c=0; c<m; c++) {
+    for (size_t k=first; k<first+n; k++)
+      mean[c]+=x[c][k];
+    mean[c]/=n;
+    all+=mean[c];
+  }
+  all/=m;
+  for (size_t c=0; c<m; c++) {
+    double v=0.0;
+    for (size_t k=first; k<first+n; k++)
+      v+=(x[c][k]-mean[c])*(x[c][k]-mean[c]);
+    W+=v/(n-1);
+    B+=(mean[c]-all)*(mean[c]-all);
+  }
+  W/=m;
+  B*=(double)n/(m-1);
+  if (!(W>0.0))
+    return B>0.0 ? HUGE_VAL : 1.0;
+  double var=(n-1.0)/n*W+B/n;
+  return sqrt(var/W);
+};
+
+struct mchaininfo {
+  size_t burnin;                    // burn-in steps of each chain
+  bool converged;                   // every R-hat below MCHAIN_RHAT
+  std::vector<double> rhat;         // R-hat of each bin at the end of the burn-in
+  std::vector<double> acceptance;   // acceptance rate of each chain
+};
+
+/* nchains chains, nsim replicates of each (chain c: columns c*nsim ...
+ * (c+1)*nsim-1 of res) every opt.thin steps after the burn-in */
+template <class CHAIN>
+mchaininfo mchain_run(const double *pi,size_t q,size_t r,const mcmcopt &opt,size_t nchains,int *res,size_t nsim,uint64_t seed,int nthreads) {
+  std::vector<CHAIN> chain(nchains,CHAIN(pi,q,r));
+  std::vector<philox> g;
+  for (size_t c=0; c<nchains; c++)
+    g.push_back(philox(seed,c));
+
+  // bins of individuals by rank of pi
+  size_t nbins=q<MCHAIN_BINS ? q : MCHAIN_BINS;
+  std::vector<size_t> order(q),bin(q);
+  for (size_t i=0; i<q; i++)
+    order[i]=i;
+  std::stable_sort(order.begin(),order.end(),[pi](size_t i,size_t j) { return pi[i]<pi[j]; });
+  for (size_t k=0; k<q; k++)
+    bin[order[k]]=k*nbins/q;
+  // trace[b][c]: records of bin b for chain c
+  std::vector<std::vector<std::vector<double> > > trace(nbins,std::vector<std::vector<double> >(nchains));
+
+  mchaininfo info;
+  info.converged=false;
+  size_t maxburnin=opt.burnin>0 ? opt.burnin : opt.maxburnin;
+  size_t done=0,sweeps=0,check=20;
+  bool frozen=true;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(static,1)
+#endif
+  for (long c=0; c<(long)nchains; c++)
+    chain[c].start(g[c]);
+  for (size_t c=0; c<nchains; c++)
+    frozen=frozen && chain[c].frozen();
+
+  std::vector<double> count(nchains*nbins);
+  while (done<maxburnin && !frozen) {
+    size_t steps=q<maxburnin-done ? q : maxburnin-done;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(static,1)
+#endif
+    for (long c=0; c<(long)nchains; c++) {
+      chain[c].run(steps,g[c]);
+      double *n=&count[c*nbins];
+      for (size_t b=0; b<nbins; b++)
+	n[b]=0.0;
+      for (size_t i=0; i<q; i++)
+	n[bin[i]]+=chain[c].state[i];
+    }
+    done+=steps;
+    sweeps++;
+    // exchange the summaries
+    for (size_t c=0; c<nchains; c++)
+      for (size_t b=0; b<nbins; b++)
+	trace[b][c].push_back(count[c*nbins+b]);
+    if (opt.burnin==0 && sweeps>=check) {
+      bool moved=true;
+      for (size_t c=0; c<nchains; c++)
+	moved=moved && chain[c].accepted>=q;
+      double worst=0.0;
+      for (size_t b=0; b<nbins; b++)
+	worst=std::max(worst,rhat(trace[b],sweeps-sweeps/2,sweeps/2));
+      if (moved && worst<MCHAIN_RHAT)
+	break;
+      check+=check/4;
+    }
+  }
+  info.burnin=done;
+
+  info.rhat.resize(nbins);
+  info.converged=true;
+  for (size_t b=0; b<nbins; b++) {
+    info.rhat[b]=frozen ? 1.0 : rhat(trace[b],sweeps-sweeps/2,sweeps/2);
+    if (!(info.rhat[b]<MCHAIN_RHAT))
+      info.converged=false;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(static,1)
+#endif
+  for (long c=0; c<(long)nchains; c++)
+    for (size_t k=0; k<nsim; k++) {
+      if (k>0)
+	chain[c].run(opt.thin,g[c]);
+      chain[c].output(res+(c*nsim+k)*q);
+    }
+
+  for (size_t c=0; c<nchains; c++) {
+    const CHAIN &x=chain[c];
+    info.acceptance.push_back(x.proposed>0 ? (double)x.accepted/(double)x.proposed : 1.0);
+  }
+  return info;
+};
+
+inline mchaininfo mchain_run(const double *pi,size_t q,size_t r,const mcmcopt &opt,size_t nchains,int *res,size_t nsim,uint64_t seed,int nthreads) {
+  if (opt.weighted)
+    return mchain_run<wchain>(pi,q,r,opt,nchains,res,nsim,seed,nthreads);
+  return mchain_run<mcmcchain>(pi,q,r,opt,nchains,res,nsim,seed,nthreads);
+};
+
+}
+
+#endif
@@ -0,0 +1,375 @@
+#ifndef _waffect_MCMC_H
+#define _waffect_MCMC_H
+
+#include <vector>
+#include <cmath>
+#include "rng.h"
+#include "tilt.h"
+#include "fenwick.h"
+
+namespace waffect {
+
+/* starting configuration: independent Bernoulli draws of the pi tilted so
+ * that r cases are expected (see tilt.h), completed or thinned uniformly to
+ * r cases among the individuals with 0<pi<1, close to the target
+ * distribution */
+template <class RNG>
+void mcmc_start(const double *pi,size_t q,size_t r,char *s,RNG &g) {
+  double logtheta=tilt(pi,q,r);
+  std::vector<size_t> in,out;
+  for (size_t i=0; i<q; i++) {
+    s[i]=draw(g,tilted(pi[i],logtheta));
+    if (pi[i]>0.0 && pi[i]<1.0)
+      (s[i] ? in : out).push_back(i);
+  }
+  size_t n=0;
+  for (size_t i=0; i<q; i++)
+    n+=s[i];
+  for (; n<r; n++) {
+    size_t k=g.index(out.size());
+    s[out[k]]=1;
+    out[k]=out.back();
+    out.pop_back();
+  }
+  for (; n>r; n--) {
+    size_t k=g.index(in.size());
+    s[in[k]]=0;
+    in[k]=in.back();
+    in.pop_back();
+  }
+};
+
+/*
+ * Metropolis-Hastings over the configurations with exactly r cases: a
+ * random control i0 and a random case i1 are proposed for a swap, accepted
+ * with probability pi[i0](1-pi[i1])/(pi[i1](1-pi[i0])) = odds[i0]*inverse
+ * odds[i1], both arrays being computed once.
+ *
+ * The chain also follows stat = sum of pi over the cases, which is used to
+ * decide when the burn-in is over (see mcmc_run).
+ */
+class mcmcchain {
+public:
+  const double *pi;
+  size_t q,r;
+  std::vector<double> odds,inv;       // pi/(1-pi) and (1-pi)/pi
+  std::vector<size_t> cases,controls;
+  std::vector<char> state;
+  double stat;
+  size_t proposed,accepted;
+
+  mcmcchain(const double *ppi,size_t qq,size_t rr) : pi(ppi), q(qq), r(rr), odds(qq), inv(qq), state(qq,0), stat(0.0), proposed(0), accepted(0) {
+    for (size_t i=0; i<q; i++) {
+      odds[i]=pi[i]<1.0 ? pi[i]/(1.0-pi[i]) : HUGE_VAL;
+      inv[i]=pi[i]>0.0 ? (1.0-pi[i])/pi[i] : HUGE_VAL;
+    }
+  }
+
+  /* the r first individuals are cases */
+  void first() {
+    std::vector<char> s(q,0);
+    for (size_t i=0; i<r && i<q; i++)
+      s[i]=1;
+    set(&s[0]);
+  }
+
+  template <class RNG>
+  void start(RNG &g) {
+    std::vector<char> s(q);
+    mcmc_start(pi,q,r,&s[0],g);
+    set(&s[0]);
+  }
+
+  void set(const char *s) {
+    cases.clear();
+    controls.clear();
+    stat=0.0;
+    for (size_t i=0; i<q; i++) {
+      state[i]=s[i];
+      if (s[i]) {
+	cases.push_back(i);
+	stat+=pi[i];
+      } else {
+	controls.push_back(i);
+      }
+    }
+  }
+
+  /* steps proposals */
+  template <class RNG>
+  void run(size_t steps,RNG &g) {
+    if (cases.empty() || controls.empty())
+      return;
+    size_t n0=controls.size(),n1=cases.size();
+    for (size_t iter=0; iter<steps; iter++) {
+      // propose move
+      size_t pos0=g.index(n0);
+      size_t pos1=g.index(n1);
+      size_t i0=controls[pos0];
+      size_t i1=cases[pos1];
+
+      if (draw(g,odds[i0]*inv[i1])) {
+	// accept move
+	cases[pos1]=i0;
+	controls[pos0]=i1;
+	state[i0]=1;
+	state[i1]=0;
+	stat+=pi[i0]-pi[i1];
+	accepted++;
+      }
+    }
+    proposed+=steps;
+  }
+
+  void output(int *res) const {
+    for (size_t i=0; i<q; i++)
+      res[i]=state[i];
+  }
+
+  /* no swap can be proposed */
+  bool frozen() const { return cases.empty() || controls.empty(); }
+};
+
+/*
+ * Same chain with weighted proposals: the control i0 is chosen with
+ * probability proportional to a[i0]=sqrt(odds[i0]) and the case i1 with
+ * probability proportional to b[i1]=1/sqrt(odds[i1]), by two Fenwick trees.
+ * With A and B the sums of a over the controls and of b over the cases, the
+ * Metropolis-Hastings ratio reduces to A*B/(A'*B') (A', B' after the swap),
+ * close to 1 for large samples whatever the spread of the pi. Individuals
+ * with pi=0 or pi=1 are left out of the chain. O(log q) per step.
+ */
+class wchain {
+public:
+  const double *pi;
+  size_t q,r;
+  std::vector<size_t> id;      // chain position k -> individual
+  std::vector<double> a,b,x;   // x: work array
+  fenwick F0,F1;               // controls (weights a), cases (weights b)
+  std::vector<char> state;
+  double A,B,stat;
+  size_t ncases,proposed,accepted,since;
+
+  wchain(const double *ppi,size_t qq,size_t rr) : pi(ppi), q(qq), r(rr), state(qq,0), A(0.0), B(0.0), stat(0.0), ncases(0), proposed(0), accepted(0), since(0) {
+    for (size_t i=0; i<q; i++)
+      if (pi[i]>0.0 && pi[i]<1.0) {
+	id.push_back(i);
+	double s=sqrt(pi[i]/(1.0-pi[i]));
+	a.push_back(s);
+	b.push_back(1.0/s);
+      }
+    x.resize(id.size());
+    F0.resize(id.size());
+    F1.resize(id.size());
+  }
+
+  template <class RNG>
+  void start(RNG &g) {
+    std::vector<char> s(q);
+    mcmc_start(pi,q,r,&s[0],g);
+    set(&s[0]);
+  }
+
+  void set(const char *s) {
+    stat=0.0;
+    for (size_t i=0; i<q; i++) {
+      state[i]=s[i];
+      if (s[i])
+	stat+=pi[i];
+    }
+    ncases=0;
+    for (size_t k=0; k<id.size(); k++)
+      ncases+=state[id[k]];
+    rebuild();
+  }
+
+  /* recompute the trees and the sums from scratch (limits the round-off
+   * drift of the incremental updates) */
+  void rebuild() {
+    for (size_t k=0; k<id.size(); k++)
+      x[k]=state[id[k]] ? 0.0 : a[k];
+    F0.assign(x.empty() ? 0 : &x[0]);
+    for (size_t k=0; k<id.size(); k++)
+      x[k]=state[id[k]] ? b[k] : 0.0;
+    F1.assign(x.empty() ? 0 : &x[0]);
+    A=F0.total();
+    B=F1.total();
+    since=0;
+  }
+
+  template <class RNG>
+  void run(size_t steps,RNG &g) {
+    if (frozen())
+      return;
+    for (size_t iter=0; iter<steps; iter++) {
+      // propose move
+      size_t k0=F0.find(g.unif()*A);
+      size_t k1=F1.find(g.unif()*B);
+      if (!(F0[k0]>0.0 && F1[k1]>0.0))
+	continue;   // round-off at a boundary of the trees
+      double a0=a[k0],b0=b[k0],a1=a[k1],b1=b[k1];
+      double A1=A-a0+a1,B1=B-b1+b0;
+
+      if (draw(g,(A*B)/(A1*B1))) {
+	// accept move
+	F0.set(k0,0.0);
+	F0.set(k1,a1);
+	F1.set(k1,0.0);
+	F1.set(k0,b0);
+	A=A1;
+	B=B1;
+	size_t i0=id[k0],i1=id[k1];
+	state[i0]=1;
+	state[i1]=0;
+	stat+=pi[i0]-pi[i1];
+	accepted++;
+	if (++since>=id.size())
+	  rebuild();
+      }
+    }
+    proposed+=steps;
+  }
+
+  void output(int *res) const {
+    for (size_t i=0; i<q; i++)
+      res[i]=state[i];
+  }
+
+  bool frozen() const { return ncases==0 || ncases==id.size(); }
+};
+
+/* Geweke's diagnostic on the second half of trace: z score of the difference
+ * between the means of its first 20% and last 50%, the variance being
+ * inflated by (1+rho)/(1-rho) for the lag one autocorrelation rho */
+inline double geweke(const std::vector<double> &trace) {
+  size_t n=trace.size()/2;
+  const double *x=&trace[trace.size()-n];
+  size_t na=n/5,nb=n/2;
+  if (na<2)
+    return HUGE_VAL;
+  double ma=0.0,mb=0.0,m=0.0;
+  for (size_t k=0; k<na; k++)
+    ma+=x[k];
+  for (size_t k=n-nb; k<n; k++)
+    mb+=x[k];
+  for (size_t k=0; k<n; k++)
+    m+=x[k];
+  ma/=na;
+  mb/=nb;
+  m/=n;
+  double v=0.0,c=0.0;
+  for (size_t k=0; k<n; k++) {
+    v+=(x[k]-m)*(x[k]-m);
+    if (k>0)
+      c+=(x[k]-m)*(x[k-1]-m);
+  }
+  if (!(v>0.0))
+    return HUGE_VAL;   // the chain did not move
+  double rho=c/v;
+  if (rho>0.99)
+    rho=0.99;
+  if (rho<0.0)
+    rho=0.0;
+  v=v/(n-1)*(1.0+rho)/(1.0-rho);
+  return (ma-mb)/sqrt(v*(1.0/na+1.0/nb));
+};
+
+struct mcmcopt {
+  size_t burnin;      // number of burn-in steps, 0 for automatic
+  size_t maxburnin;   // automatic burn-in: upper bound
+  size_t thin;        // steps between two replicates
+  bool weighted;      // weighted proposals (wchain)
+};
+
+struct mcmcinfo {
+  size_t burnin;      // burn-in steps actually done
+  bool converged;     // automatic burn-in: diagnostic passed
+  double acceptance;  // acceptance rate over the whole run
+};
+
+/* automatic burn-in: the chain runs by sweeps of q proposals, stat being
+ * recorded after each one; the burn-in stops when Geweke's diagnostic on
+ * the second half of the record is below 2 (checked whenever the number of
+ * sweeps has grown by 25%, at least 20 sweeps and q accepted moves) or at
+ * maxburnin steps */
+template <class CHAIN,class RNG>
+size_t mcmc_burnin(CHAIN &c,size_t maxburnin,bool &converged,RNG &g) {
+  size_t q=c.q,done=0,check=20;
+  std::vector<double> trace;
+  converged=false;
+  if (c.frozen()) {
+    converged=true;
+    return 0;
+  }
+  while (done<maxburnin) {
+    size_t steps=q<maxburnin-done ? q : maxburnin-done;
+    c.run(steps,g);
+    done+=steps;
+    trace.push_back(c.stat);
+    if (trace.size()>=check) {
+      if (c.accepted>=q && fabs(geweke(trace))<2.0) {
+	converged=true;
+	break;
+      }
+      check+=check/4;
+    }
+  }
+  return done;
+};
+
+/* nsim replicates (columns of res) from one chain: burn-in then one replicate
+ * every opt.thin steps */
+template <class CHAIN,class RNG>
+mcmcinfo mcmc_run(CHAIN &c,const mcmcopt &opt,int *res,size_t nsim,RNG &g) {
+  size_t q=c.q;
+  mcmcinfo info;
+  c.start(g);
+  if (opt.burnin>0) {
+    c.run(opt.burnin,g);
+    info.burnin=opt.burnin;
+    info.converged=true;
+  } else {
+    info.burnin=mcmc_burnin(c,opt.maxburnin,info.converged,g);
+  }
+  for (size_t k=0; k<nsim; k++) {
+    if (k>0)
+      c.run(opt.thin,g);
+    c.output(res+k*q);
+  }
+  info.acceptance=c.proposed>0 ? (double)c.accepted/(double)c.proposed : 1.0;
+  return info;
+};
+
+template <class RNG>
+mcmcinfo mcmc_run(const double *pi,size_t q,size_t r,const mcmcopt &opt,int *res,size_t nsim,RNG &g) {
+  if (opt.weighted) {
+    wchain c(pi,q,r);
+    return mcmc_run(c,opt,res,nsim,g);
+  }
+  mcmcchain c(pi,q,r);
+  return mcmc_run(c,opt,res,nsim,g);
+};
+
+/* one replicate after burnin steps from the configuration "r first
+ * individuals are cases" (burnin=0 or weighted proposals: burn-in from a
+ * random start, automatic if burnin=0) */
+template <class RNG>
+void mcmc(const double *pi,size_t q,size_t r,size_t burnin,int *res,RNG &g,bool weighted=false) {
+  if (burnin==0 || weighted) {
+    mcmcopt opt;
+    opt.burnin=burnin;
+    opt.maxburnin=10000*q;
+    opt.thin=q;
+    opt.weighted=weighted;
+    mcmc_run(pi,q,r,opt,res,1,g);
+    return;
+  }
+  mcmcchain c(pi,q,r);
+  c.first();
+  c.run(burnin,g);
+  c.output(res);
+};
+
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef _waffect_MODEL_H
+#define _waffect_MODEL_H
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+
+namespace waffect {
+
+/*
+ * Disease models: pi_j from the genotypes of individual j. The linear
+ * predictor
+ *   eta_j = sum_s beta_s x_js + sum_(s,t) gamma_st x_js x_jt + sum_c alpha_c z_jc
+ * (x the dosages 0,1,2 of the model SNPs, z the covariates) gives
+ *   additive:        pi_j = f0*(1+eta_j)
+ *   multiplicative:  pi_j = f0*exp(eta_j)        (beta: log relative risks)
+ *   logistic:        pi_j = 1/(1+exp(-logit(f0)-eta_j))
+ * the first two being truncated to [0,1]. With a link and an offset
+ *   log:   pi_j = min(1,exp(b+o_j)), b=log(f0), o_j=log(max(0,1+eta_j)) or eta_j
+ *   logit: pi_j = sigmoid(b+o_j),    b=logit(f0), o_j=eta_j
+ * the baseline b can be calibrated so that sum(pi) is the number of cases:
+ * sum(pi) increases with b.
+ */
+
+enum { MODEL_ADDITIVE, MODEL_MULTIPLICATIVE, MODEL_LOGISTIC };
+
+struct model {
+  int type;
+  double f0;                        // baseline penetrance (eta=0)
+  std::vector<size_t> snp;          // columns of the genotype matrix
+  std::vector<double> beta;
+  std::vector<size_t> first,second; // pairwise interactions
+  std::vector<double> gamma;
+  const double *cov;                // n x ncov covariates (column major)
+  size_t ncov;
+  std::vector<double> alpha;
+
+  model() : type(MODEL_ADDITIVE), f0(0.1), cov(0), ncov(0) {}
+};
+
+/* dosage of a genotype, 0 if missing (anything but 0, 1 or 2) */
+template <class G>
+inline double dosage(G x) {
+  return x>=0 && x<=2 ? (double)x : 0.0;
+};
+
+/* genotypes of n individuals as an n x nsnp matrix (column major); any
+ * source with individuals(), snps() and dosages(s,x) can stand for it (see
+ * plink.h) */
+template <class G>
+struct dense_genotypes {
+  const G *geno;
+  size_t n,nsnp;
+
+  dense_genotypes(const G *ggeno,size_t nn,size_t nnsnp) : geno(ggeno), n(nn), nsnp(nnsnp) {}
+  size_t individuals() const { return n; }
+  size_t snps() const { return nsnp; }
+
+  /* dosages of SNP s in x[0 ... n-1] */
+  void dosages(size_t s,double *x) const {
+    const G *g=geno+s*n;
+    for (size_t j=0; j<n; j++)
+      x[j]=dosage(g[j]);
+  }
+};
+
+/* eta of the individuals; each term is a loop over the dosages of a SNP */
+template <class GENO>
+void model_eta(const model &M,const GENO &X,double *eta) {
+  size_t n=X.individuals(),nsnp=X.snps();
+  std::vector<double> x(n),y(n);
+  for (size_t j=0; j<n; j++)
+    eta[j]=0.0;
+  for (size_t k=0; k<M.snp.size(); k++) {
+    if (M.snp[k]>=nsnp)
+      throw std::invalid_argument("SNP out of the genotype matrix");
+    X.dosages(M.snp[k],&x[0]);
+    double b=M.beta[k];
+    for (size_t j=0; j<n; j++)
+      eta[j]+=b*x[j];
+  }
+  for (size_t k=0; k<M.gamma.size(); k++) {
+    if (M.first[k]>=nsnp || M.second[k]>=nsnp)
+      throw std::invalid_argument("SNP out of the genotype matrix");
+    X.dosages(M.first[k],&x[0]);
+    X.dosages(M.second[k],&y[0]);
+    double g=M.gamma[k];
+    for (size_t j=0; j<n; j++)
+      eta[j]+=g*x[j]*y[j];
+  }
+  for (size_t c=0; c<M.ncov; c++) {
+    const double *z=M.cov+c*n;
+    double a=M.alpha[c];
+    for (size_t j=0; j<n; j++)
+      eta[j]+=a*z[j];
+  }
+};
+
+/* eta -> offset of the link, in place */
+inline void model_offset(int type,double *eta,size_t n) {
+  if (type==MODEL_ADDITIVE)
+    for (size_t j=0; j<n; j++)
+      eta[j]=1.0+eta[j]>0.0 ? log1p(eta[j]) : -HUGE_VAL;
+};
+
+inline double model_base(int type,double f0) {
+  if (!(f0>0.0 && f0<1.0))
+    throw std::invalid_argument("the baseline penetrance must be in (0,1)");
+  return type==MODEL_LOGISTIC ? log(f0)-log1p(-f0) : log(f0);
+};
+
+inline double model_prob(int type,double base,double offset) {
+  double x=base+offset;
+  if (type!=MODEL_LOGISTIC)
+    return x<0.0 ? exp(x) : 1.0;
+  return x>=0 ? 1.0/(1.0+exp(-x)) : exp(x)/(1.0+exp(x));
+};
+
+/* baseline b such that sum_j pi_j = target */
+inline double model_calibrate(int type,const double *offset,size_t n,double target) {
+  double sup=0.0,sum=0.0;
+  for (size_t j=0; j<n; j++)
+    if (offset[j]>-HUGE_VAL) {
+      sup+=1.0;
+      sum+=exp(offset[j]<700.0 ? offset[j] : 700.0);
+    }
+  bool logit=type==MODEL_LOGISTIC;
+  if (!(target>0.0) || target>sup || (logit && target>=sup))
+    throw std::invalid_argument("the number of cases cannot be reached by calibrating the baseline");
+
+  // f(b)=sum pi_j(b)-target is increasing: Newton's method safeguarded by
+  // bisection on [lo,hi], started from the untruncated solution
+  double lo=-800.0,hi=800.0;
+  double t=logit ? log(target)-log(sup-target) : log(target)-log(sum);
+  if (!(t>lo && t<hi))
+    t=0.0;
+  for (int iter=0; iter<200; iter++) {
+    double f=-target,df=0.0;
+    for (size_t j=0; j<n; j++) {
+      double p=model_prob(type,t,offset[j]);
+      f+=p;
+      df+=logit ? p*(1.0-p) : (p<1.0 ? p : 0.0);
+    }
+    if (f>0.0)
+      hi=t;
+    else
+      lo=t;
+    if (fabs(f)<1e-10*(1.0+target))
+      break;
+    double next=df>0.0 ? t-f/df : 0.5*(lo+hi);
+    if (!(next>lo && next<hi))
+      next=0.5*(lo+hi);
+    if (fabs(next-t)<1e-15*(1.0+fabs(t)))
+      break;
+    t=next;
+  }
+  return t;
+};
+
+/* pi of the individuals; with target>0 the baseline is calibrated so that
+ * sum(pi)=target. Returns the baseline penetrance f0 used. */
+template <class GENO>
+double model_pi(const model &M,const GENO &X,double *pi,double target=0.0) {
+  if (M.beta.size()!=M.snp.size() || M.gamma.size()!=M.first.size() || M.gamma.size()!=M.second.size() || M.alpha.size()!=M.ncov)
+    throw std::invalid_argument("one effect per SNP, interaction and covariate is needed");
+  size_t n=X.individuals();
+  if (n==0)
+    return M.f0;
+  model_eta(M,X,pi);
+  model_offset(M.type,pi,n);
+  double base=target>0.0 ? model_calibrate(M.type,pi,n,target) : model_base(M.type,M.f0);
+  for (size_t j=0; j<n; j++)
+    pi[j]=model_prob(M.type,base,pi[j]);
+  return M.type==MODEL_LOGISTIC ? 1.0/(1.0+exp(-base)) : exp(base);
+};
+
+/* the same from an n x nsnp matrix of dosages */
+template <class G>
+double model_pi(const model &M,const G *geno,size_t n,size_t nsnp,double *pi,double target=0.0) {
+  return model_pi(M,dense_genotypes<G>(geno,n,nsnp),pi,target);
+};
+
+}
+
+#endif
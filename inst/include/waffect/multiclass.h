@@ -0,0 +1,135 @@
+#ifndef _waffect_MULTICLASS_H
+#define _waffect_MULTICLASS_H
+
+#include <vector>
+#include <stdexcept>
+#include "backward.h"
+#include "mcmc.h"
+#include "reject.h"
+#include "ptree.h"
+#include "grouped.h"
+#include "planner.h"
+
+namespace waffect {
+
+/* binary engine used by the multiclass sampler */
+struct binopt {
+  int method;      // BACKWARD, MCMC, REJECT, FFT, GROUPED or AUTO (planner.h)
+  bool scaled;     // backward: row-scaled table
+  double budget;   // backward: memory budget in bytes (<=0 no limit)
+  double tol;      // backward: truncation tolerance
+  size_t burnin;   // mcmc: number of steps, 0 for automatic
+  bool weighted;   // mcmc: weighted proposals
+};
+
+template <class RNG>
+double binary(const double *pi,size_t q,size_t r,int *res,RNG &g,const binopt &opt) {
+  switch (opt.method) {
+  case MCMC:
+    mcmc(pi,q,r,opt.burnin,res,g,opt.weighted);
+    return 0.0;
+  case REJECT:
+    reject(pi,q,r,res,g);
+    return 0.0;
+  case FFT: {
+    // the tree draws from a philox stream seeded by g
+    ptree T(pi,q,r);
+    std::vector<size_t> cases;
+    T.sample(res,(uint64_t)(g.unif()*9007199254740992.0),0,cases);
+    return 0.0;
+  }
+  case GROUPED: {
+    grouped G(pi,q,r);
+    std::vector<size_t> work;
+    G.sample(res,g,work);
+    return 0.0;
+  }
+  case AUTO: {
+    // cheapest exact engine (planner.h), the xdouble backward table if the
+    // chosen one fails on underflow
+    plan p=make_plan(pi,q,r,1,opt.budget);
+    binopt o=opt;
+    o.method=plan_method(p.engine);
+    o.scaled=true;
+    o.tol=0.0;
+    try {
+      return binary(pi,q,r,res,g,o);
+    } catch (std::range_error &e) {
+      o.method=BACKWARD;
+      o.scaled=false;
+      return binary(pi,q,r,res,g,o);
+    }
+  }
+  default:
+    if (opt.scaled)
+      return forward_budget<double>(r,opt.budget,pi,q,res,g,opt.tol);
+    else
+      return forward_budget<xdouble>(r,opt.budget,pi,q,res,g,opt.tol);
+  }
+};
+
+/* K classes: prob is K x n (column major), count[k] individuals are put in
+ * class k+1 (cls[j] in 1..K), the counts sum to n. Class k is sampled
+ * against classes k+1..K among the individuals not yet affected, with
+ * pi_j = prob[k,j]/sum_{l>=k} prob[l,j]; a class with a zero count (such
+ * as every class after the individuals are all affected) is skipped. The
+ * suffix sums are updated in place and the remaining individuals are
+ * compacted after each class. Returns the discarded mass. */
+template <class RNG>
+double multiclass(const double *prob,size_t K,size_t n,const int *count,int *cls,RNG &g,const binopt &opt) {
+  std::vector<double> suffix(n,0.0),p(n);
+  std::vector<size_t> idx(n);
+  std::vector<int> res(n);
+  double discarded=0.0;
+
+  size_t total=0;
+  for (size_t k=0; k<K; k++) {
+    if (count[k]<0)
+      throw std::invalid_argument("negative count");
+    total+=count[k];
+  }
+  if (total!=n)
+    throw std::invalid_argument("the counts must sum to the number of individuals");
+
+  for (size_t j=0; j<n; j++) {
+    const double *col=prob+j*K;
+    for (size_t k=0; k<K; k++)
+      suffix[j]+=col[k];
+    idx[j]=j;
+  }
+
+  size_t m=n;
+  for (size_t k=0; k+1<K; k++) {
+    if (count[k]==0) {
+      // nobody in class k+1 (in particular when nobody is left)
+      for (size_t t=0; t<m; t++)
+	suffix[idx[t]]-=prob[idx[t]*K+k];
+      continue;
+    }
+    for (size_t t=0; t<m; t++) {
+      size_t j=idx[t];
+      double x=suffix[j]>0.0 ? prob[j*K+k]/suffix[j] : 0.0;
+      p[t]=x<1.0 ? x : 1.0;
+    }
+    discarded+=binary(&p[0],m,count[k],&res[0],g,opt);
+    // affect class k+1, keep the others for the next classes
+    size_t w=0;
+    for (size_t t=0; t<m; t++) {
+      size_t j=idx[t];
+      if (res[t]) {
+	cls[j]=k+1;
+      } else {
+	suffix[j]-=prob[j*K+k];
+	idx[w++]=j;
+      }
+    }
+    m=w;
+  }
+  for (size_t t=0; t<m; t++)
+    cls[idx[t]]=K;
+  return discarded;
+};
+
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _waffect_PACKED_H
+#define _waffect_PACKED_H
+
+#include <cstring>
+#include <stdint.h>
+
+namespace waffect {
+
+/*
+ * Replicates packed one bit per individual: individual i of a replicate is
+ * bit i%8 of byte i/8 of its column (1 for a case), the unused bits of the
+ * last byte are zero. A column takes (q+7)/8 bytes instead of 4q for an R
+ * logical vector, and the number of cases among a set of individuals is the
+ * popcount of the column and-ed with a mask packed the same way.
+ */
+
+inline size_t packed_bytes(size_t q) {
+  return (q+7)/8;
+};
+
+inline void pack(const int *res,size_t q,unsigned char *col) {
+  memset(col,0,packed_bytes(q));
+  for (size_t i=0; i<q; i++)
+    if (res[i])
+      col[i>>3]|=(unsigned char)(1u<<(i&7));
+};
+
+inline void unpack(const unsigned char *col,size_t q,int *res) {
+  for (size_t i=0; i<q; i++)
+    res[i]=(col[i>>3]>>(i&7))&1;
+};
+
+inline unsigned popcount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (unsigned)__builtin_popcountll(x);
+#else
+  x=x-((x>>1)&0x5555555555555555ULL);
+  x=(x&0x3333333333333333ULL)+((x>>2)&0x3333333333333333ULL);
+  x=(x+(x>>4))&0x0f0f0f0f0f0f0f0fULL;
+  return (unsigned)((x*0x0101010101010101ULL)>>56);
+#endif
+};
+
+/* number of cases of a column of nbytes bytes, among the individuals of
+ * mask if not null; 8 bytes at a time */
+inline size_t packed_count(const unsigned char *col,const unsigned char *mask,size_t nbytes) {
+  size_t n=0,b=0;
+  uint64_t x,m;
+  for (; b+8<=nbytes; b+=8) {
+    memcpy(&x,col+b,8);
+    if (mask) {
+      memcpy(&m,mask+b,8);
+      x&=m;
+    }
+    n+=popcount64(x);
+  }
+  for (; b<nbytes; b++)
+    n+=popcount64(mask ? col[b]&mask[b] : col[b]);
+  return n;
+};
+
+}
+
+#endif
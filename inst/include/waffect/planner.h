@@ -0,0 +1,101 @@
+#ifndef _waffect_PLANNER_H
+#define _waffect_PLANNER_H
+
+#include <cmath>
+#include <unordered_set>
+#include "btable.h"
+#include "backward.h"
+#include "tilt.h"
+
+namespace waffect {
+
+/*
+ * Choice of the exact binary engine for method="auto". The running time of
+ * each engine is estimated from the shape of the problem with the costs
+ * below (seconds per elementary operation, measured on a recent x86-64 with
+ * the scaled backward table vectorized by kernel.h); an engine whose
+ * memory does not fit within the budget is discarded.
+ */
+
+const double PLAN_CELL=1.5e-9;      // backward: one cell of the scaled table
+const double PLAN_TREE=1.0e-8;      // fft: one unit of q log2(q)^2 (build)
+const double PLAN_WALK=2.5e-9;      // fft: one unit of q log2(q) (one draw)
+const double PLAN_GROUP=3.0e-8;     // grouped: one unit of G r log2(r) (build)
+const double PLAN_DRAW=1.5e-9;      // grouped, backward: one individual (one draw)
+const double PLAN_BERNOULLI=1.5e-8; // reject: one individual in one pass
+const size_t PLAN_GROUPS=1024;      // grouped is not considered beyond
+
+/* method codes of binopt (multiclass.h) */
+enum method { BACKWARD=0, MCMC=1, REJECT=2, FFT=3, GROUPED=4, AUTO=5 };
+
+enum { PLAN_BACKWARD, PLAN_FFT, PLAN_GROUPED, PLAN_REJECT, PLAN_ENGINES };
+
+struct plan {
+  int engine;                  // PLAN_BACKWARD ...
+  double cost[PLAN_ENGINES];   // estimated seconds, HUGE_VAL if out of budget
+  size_t groups;               // distinct pi in (0,1), PLAN_GROUPS+1 if more
+  double variance;             // variance of the number of cases (tilted pi)
+};
+
+/* binopt method code of an engine */
+inline int plan_method(int engine) {
+  static const int code[PLAN_ENGINES]={BACKWARD,FFT,GROUPED,REJECT};
+  return code[engine];
+};
+
+inline plan make_plan(const double *pi,size_t q,size_t r,size_t nsim,double budget) {
+  plan p;
+  double n=(double)q,s=(double)(nsim>0 ? nsim : 1);
+  double lq=log2(n>2.0 ? n : 2.0);
+  double lr=log2(r>2 ? (double)r : 2.0);
+  double band=(double)(r<q-r ? r : q-r)+1.0;
+
+  // distinct probabilities strictly between 0 and 1
+  std::unordered_set<double> seen;
+  for (size_t i=0; i<q && seen.size()<=PLAN_GROUPS; i++)
+    if (pi[i]>0.0 && pi[i]<1.0)
+      seen.insert(pi[i]);
+  p.groups=seen.size();
+
+  // backward: the whole table, or twice the work with checkpoints
+  double row=(double)btable<double>::rowbytes(r+2);
+  p.cost[PLAN_BACKWARD]=n*band*PLAN_CELL+s*n*PLAN_DRAW;
+  if (budget>0.0 && n*row>budget) {
+    if (nsim>1 || segment_length<double>(q,r,budget)==0)
+      p.cost[PLAN_BACKWARD]=HUGE_VAL;
+    else
+      p.cost[PLAN_BACKWARD]=2.0*n*band*PLAN_CELL;
+  }
+
+  // fft: about q log2(q) coefficients
+  p.cost[PLAN_FFT]=n*lq*lq*PLAN_TREE+s*n*lq*PLAN_WALK;
+  if (budget>0.0 && 8.0*n*(lq+1.0)>budget)
+    p.cost[PLAN_FFT]=HUGE_VAL;
+
+  // grouped: G binomials and G rows of r+1 entries
+  double G=(double)p.groups;
+  p.cost[PLAN_GROUPED]=HUGE_VAL;
+  if (p.groups<=PLAN_GROUPS && !(budget>0.0 && 16.0*(G+1.0)*(r+1.0)>budget))
+    p.cost[PLAN_GROUPED]=G*(r+1.0)*lr*PLAN_GROUP+s*(G*(r+1.0)+n)*PLAN_DRAW;
+
+  // reject: sqrt(2 pi v) passes on average, v the variance of the number of
+  // cases under the tilted pi
+  double logtheta=tilt(pi,q,r),v=0.0;
+  for (size_t i=0; i<q; i++) {
+    double x=tilted(pi[i],logtheta);
+    v+=x*(1.0-x);
+  }
+  double pass=n*PLAN_BERNOULLI;
+  p.variance=v;
+  p.cost[PLAN_REJECT]=s*sqrt(2.0*M_PI*(v>1.0 ? v : 1.0))*pass;
+
+  p.engine=PLAN_BACKWARD;
+  for (int e=0; e<PLAN_ENGINES; e++)
+    if (p.cost[e]<p.cost[p.engine])
+      p.engine=e;
+  return p;
+};
+
+}
+
+#endif
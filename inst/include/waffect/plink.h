@@ -0,0 +1,322 @@
+#ifndef _waffect_PLINK_H
+#define _waffect_PLINK_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace waffect {
+
+/*
+ * PED/MAP reader (plain or gzipped text, fields separated by blanks,
+ * optionally quoted, an optional header line) into 2-bit genotypes. Not
+ * included by core.h: link with -lz.
+ *
+ * The individuals are stored by blocks of 256: within a block each SNP has
+ * one cache line of 64 bytes, individual k of the block being bits 2(k%4),
+ * 2(k%4)+1 of byte k/4 of the line, and the lines of a block follow each
+ * other in SNP order (SNP-major). A genotype is the number of minor alleles
+ * (0, 1 or 2), 3 if missing. Reading a PED line thus writes one byte in each
+ * line of the current block, in increasing addresses, and the matrix grows by
+ * whole blocks without knowing the number of individuals in advance.
+ */
+
+/* fields of a text file read through zlib (plain text is read as is) */
+class gzfields {
+  gzFile f;
+  std::string file;
+  std::vector<char> buf;
+  size_t pos,len;
+
+  gzfields(const gzfields &);
+  gzfields &operator=(const gzfields &);
+
+  void fill() {
+    int k=gzread(f,&buf[0],(unsigned)buf.size());
+    if (k<0)
+      throw std::runtime_error("cannot read "+file);
+    pos=0;
+    len=(size_t)k;
+  }
+
+  int peek() {
+    if (pos==len)
+      fill();
+    return pos<len ? (unsigned char)buf[pos] : EOF;
+  }
+
+public:
+  size_t line;   // current line (1-based)
+
+  gzfields(const std::string &ffile) : file(ffile), buf(1<<20), pos(0), len(0), line(1) {
+    f=gzopen(file.c_str(),"rb");
+    if (!f)
+      throw std::runtime_error("cannot open "+file);
+    gzbuffer(f,1<<20);
+  }
+
+  ~gzfields() {
+    gzclose(f);
+  }
+
+  /* next field of the current line in s, without its quotes; false at the
+   * end of the line */
+  bool field(std::string &s) {
+    int c=peek();
+    while (c==' ' || c=='\t' || c=='\r') {
+      pos++;
+      c=peek();
+    }
+    if (c==EOF || c=='\n')
+      return false;
+    s.clear();
+    if (c=='"' || c=='\'') {
+      int q=c;
+      pos++;
+      while ((c=peek())!=EOF && c!=q && c!='\n') {
+	s+=(char)c;
+	pos++;
+      }
+      if (c==q)
+	pos++;
+    } else {
+      while ((c=peek())!=EOF && c!=' ' && c!='\t' && c!='\r' && c!='\n') {
+	s+=(char)c;
+	pos++;
+      }
+    }
+    return true;
+  }
+
+  /* skips the end of the current line; false at the end of the file */
+  bool next() {
+    int c;
+    while ((c=peek())!=EOF && c!='\n')
+      pos++;
+    if (c==EOF)
+      return false;
+    pos++;
+    line++;
+    return peek()!=EOF;
+  }
+
+  std::string where() const {
+    char s[32];
+    snprintf(s,sizeof(s),"%zu",line);
+    return file+": line "+s;
+  }
+};
+
+inline bool integer_field(const std::string &s) {
+  char *end;
+  strtol(s.c_str(),&end,10);
+  return !s.empty() && *end==0;
+}
+
+/* missing allele codes of PLINK */
+inline bool missing_allele(char c) {
+  return c=='0' || c=='N' || c=='-' || c=='.';
+}
+
+class genotypes {
+  std::vector<unsigned char *> blocks,mem;
+  std::vector<char> a1,a2;         // alleles in the order they were met
+  std::vector<size_t> c1,c2;       // their counts
+
+  genotypes(const genotypes &);
+  genotypes &operator=(const genotypes &);
+
+  void add_block() {
+    size_t bytes=m*line;
+    unsigned char *p=(unsigned char *)std::malloc(bytes+line);
+    if (!p)
+      throw std::bad_alloc();
+    mem.push_back(p);
+    size_t addr=reinterpret_cast<size_t>(p);
+    blocks.push_back(reinterpret_cast<unsigned char *>((addr+line-1)/line*line));
+    memset(blocks.back(),0,bytes);
+  }
+
+  /* code (number of second alleles, 3 if missing) of a call a/b at SNP s */
+  unsigned code(size_t s,char a,char b) {
+    if (missing_allele(a) || missing_allele(b))
+      return 3;
+    unsigned k=0;
+    char ab[2]={a,b};
+    for (int t=0; t<2; t++) {
+      char x=ab[t];
+      if (a1[s]==0)
+	a1[s]=x;
+      if (x==a1[s]) {
+	c1[s]++;
+	continue;
+      }
+      if (a2[s]==0)
+	a2[s]=x;
+      if (x!=a2[s])
+	throw std::invalid_argument("more than two alleles");
+      c2[s]++;
+      k++;
+    }
+    return k;
+  }
+
+public:
+  static const size_t block=256;   // individuals per block
+  static const size_t line=64;     // bytes per SNP and block
+
+  size_t n,m;
+  std::vector<std::string> fid,iid,pat,mat,sex,pheno;   // PED columns 1-6
+  std::vector<std::string> chr,snp,cm,bp;               // MAP columns
+  std::vector<char> minor,major;
+  std::vector<size_t> count,missing;  // minor alleles and missing calls per SNP
+
+  genotypes() : n(0), m(0) {}
+
+  ~genotypes() {
+    for (size_t k=0; k<mem.size(); k++)
+      std::free(mem[k]);
+  }
+
+  size_t individuals() const { return n; }
+  size_t snps() const { return m; }
+
+  /* cache line of SNP s in block b */
+  const unsigned char *data(size_t b,size_t s) const {
+    return blocks[b]+s*line;
+  }
+
+  /* genotype of individual i at SNP s: 0, 1, 2 minor alleles or 3 */
+  unsigned get(size_t i,size_t s) const {
+    size_t k=i%block;
+    return (data(i/block,s)[k>>2]>>((k&3)*2))&3;
+  }
+
+  /* dosages of SNP s in x[0 ... n-1], 0 if missing (see model.h) */
+  void dosages(size_t s,double *x) const {
+    static const double value[4]={0.0,1.0,2.0,0.0};
+    for (size_t b=0; b<blocks.size(); b++) {
+      const unsigned char *p=data(b,s);
+      size_t k0=b*block,kn=std::min(n-k0,block);
+      for (size_t k=0; k<kn; k++)
+	x[k0+k]=value[(p[k>>2]>>((k&3)*2))&3];
+    }
+  }
+
+  /* the SNPs of the MAP file, then the individuals of the PED file one
+   * line at a time */
+  void read(const std::string &pedfile,const std::string &mapfile) {
+    std::string s;
+    std::vector<std::string> fields;
+    {
+      gzfields map(mapfile);
+      do {
+	fields.clear();
+	while (map.field(s))
+	  fields.push_back(s);
+	if (fields.empty())
+	  continue;
+	if (fields.size()<3 || fields.size()>4)
+	  throw std::invalid_argument(map.where()+": 3 or 4 fields expected");
+	if (!integer_field(fields.back())) {
+	  if (map.line==1)
+	    continue;    // header
+	  throw std::invalid_argument(map.where()+": the position must be an integer");
+	}
+	chr.push_back(fields[0]);
+	snp.push_back(fields[1]);
+	cm.push_back(fields.size()==4 ? fields[2] : "0");
+	bp.push_back(fields.back());
+      } while (map.next());
+    }
+    m=snp.size();
+    a1.assign(m,0);
+    a2.assign(m,0);
+    c1.assign(m,0);
+    c2.assign(m,0);
+    missing.assign(m,0);
+
+    gzfields ped(pedfile);
+    std::vector<std::string> id(6);
+    std::string a,b;
+    do {
+      size_t k=0;
+      while (k<6 && ped.field(id[k]))
+	k++;
+      if (k==0)
+	continue;
+      if (k<6)
+	throw std::invalid_argument(ped.where()+": 6 fields expected before the genotypes");
+      if (ped.line==1 && !integer_field(id[4]))
+	continue;        // header
+      if (n%block==0)
+	add_block();
+      unsigned char *p=blocks.back()+((n%block)>>2);
+      unsigned shift=(n%block&3)*2;
+      for (size_t t=0; t<m; t++,p+=line) {
+	if (!ped.field(a) || !ped.field(b))
+	  throw std::invalid_argument(ped.where()+": fewer genotypes than SNPs in "+mapfile);
+	if (a.size()!=1 || b.size()!=1)
+	  throw std::invalid_argument(ped.where()+": alleles must be single characters");
+	unsigned c;
+	try {
+	  c=code(t,a[0],b[0]);
+	} catch (std::invalid_argument &e) {
+	  throw std::invalid_argument(ped.where()+": "+e.what()+" at SNP "+snp[t]);
+	}
+	missing[t]+=c==3;
+	*p|=(unsigned char)(c<<shift);
+      }
+      if (ped.field(a))
+	throw std::invalid_argument(ped.where()+": more genotypes than SNPs in "+mapfile);
+      fid.push_back(id[0]);
+      iid.push_back(id[1]);
+      pat.push_back(id[2]);
+      mat.push_back(id[3]);
+      sex.push_back(id[4]);
+      pheno.push_back(id[5]);
+      n++;
+    } while (ped.next());
+
+    // the second allele becomes the minor one: the codes 0 and 2 of the SNPs
+    // where it is the first are exchanged, a byte at a time
+    unsigned char flip[256];
+    for (unsigned x=0; x<256; x++) {
+      unsigned y=0;
+      for (int k=0; k<8; k+=2) {
+	unsigned g=(x>>k)&3;
+	y|=(g==0 ? 2 : (g==2 ? 0 : g))<<k;
+      }
+      flip[x]=(unsigned char)y;
+    }
+    minor.resize(m);
+    major.resize(m);
+    count.resize(m);
+    for (size_t t=0; t<m; t++) {
+      bool swap=c1[t]<c2[t];
+      minor[t]=swap ? a1[t] : (a2[t] ? a2[t] : '0');
+      major[t]=swap ? a2[t] : (a1[t] ? a1[t] : '0');
+      count[t]=swap ? c1[t] : c2[t];
+      if (!swap)
+	continue;
+      for (size_t b=0; b<blocks.size(); b++) {
+	unsigned char *p=blocks[b]+t*line;
+	size_t kn=std::min(n-b*block,block);
+	for (size_t k=0; k<(kn+3)/4; k++)
+	  p[k]=flip[p[k]];
+	// the unused individuals of the last block stay 0
+	if (kn%4)
+	  p[kn/4]&=(unsigned char)((1u<<(2*(kn%4)))-1);
+      }
+    }
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef _waffect_PTREE_H
+#define _waffect_PTREE_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <stdint.h>
+#include "fft.h"
+#include "tilt.h"
+#include "rng.h"
+
+namespace waffect {
+
+/*
+ * Product tree sampler. The individuals are the leaves of a complete binary
+ * tree (heap numbering: node v has children 2v and 2v+1, leaf i is node
+ * size+i). Node v stores the polynomial prod_{i under v} (1-pi_i+pi_i x)
+ * truncated to degree r, i.e. the distribution of the number of cases under
+ * v, computed bottom-up with FFT products: O(q log^2 q) operations.
+ * A configuration with r cases is drawn top-down: a node with t cases gives a
+ * cases to its left child with probability proportional to L[a]*R[t-a].
+ *
+ * The pi are first tilted (see tilt.h) so that each node polynomial is centered
+ * on the share of the r cases it is likely to receive; each polynomial is then
+ * divided by its largest coefficient (the constants cancel in the sampling
+ * weights), so plain doubles suffice. The FFT products are accurate to about
+ * 1e-16 times the largest coefficient, weights below that level are noise.
+ * The coefficients that are structurally zero (fewer cases than the pi=1
+ * leaves below v, or more than its pi>0 leaves) are set to zero exactly, so
+ * that round-off never makes an individual with pi=1 a control or one with
+ * pi=0 a case.
+ *
+ * The tree is dynamic: when some pi change, only their leaves and the nodes
+ * above them are recomputed (update), with the tilt of the construction.
+ * The polynomials are then no longer centered: once the expected number of
+ * cases under the tilted pi is more than PTREE_DRIFT standard deviations
+ * away from r, the weights of the split points would fall below the
+ * round-off of the products, and the tilt is solved again for the whole
+ * tree.
+ */
+const double PTREE_DRIFT=3.0;
+
+class ptree {
+public:
+  size_t q,r,size;
+  double logtheta;
+  std::vector<double> base;     // probabilities
+  std::vector<double> pi;       // tilted probabilities
+  size_t ones,between;          // leaves with pi=1, with pi in (0,1)
+  double mean,variance;         // of the number of cases under the tilted pi
+  std::vector<size_t> off,len;  // coefficients of node v: coef[off[v] ... off[v]+len[v]-1]
+  std::vector<size_t> least,most; // cases under v: at least the pi=1 leaves, at most the pi>0 ones
+  std::vector<double> coef;
+
+  ptree(const double *ppi,size_t qq,size_t rr,int nthreads=1) : q(qq), r(rr), base(ppi,ppi+qq), pi(qq) {
+    if (r>q)
+      throw std::invalid_argument("more cases than individuals");
+    ones=between=0;
+    for (size_t i=0; i<q; i++)
+      count(base[i],1);
+
+    size=1;
+    while (size<q)
+      size<<=1;
+    // number of coefficients of each node: min(leaves,r)+1
+    off.resize(2*size);
+    len.resize(2*size);
+    least.resize(2*size);
+    most.resize(2*size);
+    for (size_t i=0; i<size; i++)
+      len[size+i]=i<q ? 2 : 1;
+    for (size_t v=size; v-- >1; )
+      len[v]=len[2*v]+len[2*v+1]-1;
+    size_t total=0;
+    for (size_t v=1; v<2*size; v++) {
+      if (len[v]>r+1)
+	len[v]=r+1;
+      off[v]=total;
+      total+=len[v];
+    }
+    coef.assign(total,0.0);
+    build(nthreads);
+  }
+
+  /* tilt solved for base, every node computed */
+  void build(int nthreads=1) {
+    logtheta=tilt(q>0 ? &base[0] : 0,q,r);
+    mean=variance=0.0;
+    for (size_t i=0; i<q; i++) {
+      pi[i]=tilted(base[i],logtheta);
+      mean+=pi[i];
+      variance+=pi[i]*(1.0-pi[i]);
+    }
+    for (size_t i=0; i<size; i++)
+      leaf(i);
+    // one level at a time, the nodes of a level are independent
+    for (size_t first=size>>1; first>=1; first>>=1) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic,1) if(nthreads>1)
+#endif
+      for (long v=(long)first; v<(long)(2*first); v++)
+	node(v);
+    }
+    check();
+  }
+
+  /* the leaf counts with (sign 1) or without (sign -1) a leaf of
+   * probability p */
+  void count(double p,int sign) {
+    ones+=sign*(p>=1.0);
+    between+=sign*(p>0.0 && p<1.0);
+  }
+
+  void check() const {
+    if (!(coef[off[1]+r]>0.0))
+      throw std::invalid_argument("the number of cases is not compatible with the probabilities");
+  }
+
+  /* pi[idx[j]]=p[j] for j=0 ... k-1: the leaves, then their ancestors one
+   * level at a time, each node once. O(k log q) node products instead of
+   * 2q for a new tree, unless the tilt has drifted too far (see above). The
+   * indices and the number of cases are checked first: on an error, the
+   * tree is left as it was. */
+  void update(const size_t *idx,const double *p,size_t k,int nthreads=1) {
+    for (size_t j=0; j<k; j++)
+      if (idx[j]>=q)
+	throw std::out_of_range("individual not in the tree");
+    std::vector<double> old(k);
+    for (size_t j=0; j<k; j++) {
+      old[j]=base[idx[j]];
+      count(old[j],-1);
+      count(p[j],1);
+      base[idx[j]]=p[j];
+    }
+    if (r<ones || r>ones+between) {
+      for (size_t j=k; j-- >0; ) {
+	count(base[idx[j]],-1);
+	count(old[j],1);
+	base[idx[j]]=old[j];
+      }
+      throw std::invalid_argument("the number of cases is not compatible with the probabilities");
+    }
+
+    std::vector<size_t> nodes(k);
+    for (size_t j=0; j<k; j++) {
+      double x=tilted(p[j],logtheta);
+      mean+=x-pi[idx[j]];
+      variance+=x*(1.0-x)-pi[idx[j]]*(1.0-pi[idx[j]]);
+      pi[idx[j]]=x;
+      nodes[j]=(size+idx[j])>>1;
+    }
+    // (when r fixes every leaf, there is nothing to center)
+    bool tilted=r>ones && r<ones+between;
+    if (tilted && fabs(mean-(double)r)>PTREE_DRIFT*sqrt(variance>1.0 ? variance : 1.0)) {
+      build(nthreads);
+      return;
+    }
+    for (size_t j=0; j<k; j++)
+      leaf(idx[j]);
+    // the leaves are all at the same depth, so are the nodes of each pass
+    while (!nodes.empty() && nodes[0]>=1) {
+      std::sort(nodes.begin(),nodes.end());
+      nodes.erase(std::unique(nodes.begin(),nodes.end()),nodes.end());
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic,1) if(nthreads>1)
+#endif
+      for (long t=0; t<(long)nodes.size(); t++)
+	node(nodes[t]);
+      for (size_t t=0; t<nodes.size(); t++)
+	nodes[t]>>=1;
+    }
+    check();
+  }
+
+  /* leaf polynomial (1-pi_i)+pi_i x, divided by its largest coefficient */
+  void leaf(size_t i) {
+    size_t v=size+i;
+    double *c=&coef[off[v]];
+    if (i>=q) {
+      c[0]=1.0;
+      least[v]=most[v]=0;
+      return;
+    }
+    least[v]=pi[i]>=1.0;
+    most[v]=pi[i]>0.0;
+    double p0=1.0-pi[i],p1=pi[i];
+    double m=p0>p1 ? p0 : p1;
+    c[0]=p0/m;
+    if (len[v]>1)
+      c[1]=p1/m;
+  }
+
+  /* node polynomial from its children, divided by its largest coefficient,
+   * the structural zeros exact */
+  void node(size_t v) {
+    double *c=&coef[off[v]];
+    convolve(&coef[off[2*v]],len[2*v],&coef[off[2*v+1]],len[2*v+1],c,len[v]);
+    least[v]=least[2*v]+least[2*v+1];
+    most[v]=most[2*v]+most[2*v+1];
+    for (size_t k=0; k<len[v]; k++)
+      if (k<least[v] || k>most[v])
+	c[k]=0.0;
+    double m=0.0;
+    for (size_t k=0; k<len[v]; k++)
+      if (m<c[k])
+	m=c[k];
+    if (m>0.0)
+      for (size_t k=0; k<len[v]; k++)
+	c[k]/=m;
+  }
+
+  /* number of cases given to the left child of v when v has t cases,
+   * (size_t)-1 if every weight underflowed */
+  size_t split(size_t v,size_t t,double u) const {
+    const double *L=&coef[off[2*v]],*R=&coef[off[2*v+1]];
+    size_t nl=len[2*v],nr=len[2*v+1];
+    size_t amin=t>nr-1 ? t-(nr-1) : 0;
+    size_t amax=t<nl-1 ? t : nl-1;
+    // structurally feasible splits only (see node)
+    amin=std::max(amin,std::max(least[2*v],t>most[2*v+1] ? t-most[2*v+1] : 0));
+    amax=std::min(amax,std::min(most[2*v],t>=least[2*v+1] ? t-least[2*v+1] : 0));
+    if (amin>amax)
+      return (size_t)-1;
+    double total=0.0;
+    for (size_t a=amin; a<=amax; a++)
+      total+=L[a]*R[t-a];
+    if (!(total>0.0))
+      return (size_t)-1;
+    double x=u*total;
+    for (size_t a=amin; a<amax; a++) {
+      x-=L[a]*R[t-a];
+      if (x<0.0)
+	return a;
+    }
+    return amax;
+  }
+
+  /* draw one configuration: node v uses block v of the given philox stream,
+   * so the result does not depend on the number of threads. cases is a
+   * work vector of 2*size counts. */
+  void sample(int *res,uint64_t seed,uint64_t stream,std::vector<size_t> &cases,int nthreads=1) const {
+    cases.resize(2*size);
+    cases[1]=r;
+    bool failed=false;
+    for (size_t first=1; first<size; first<<=1) {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) reduction(||:failed) if(nthreads>1 && first>=64)
+#endif
+      for (long v=(long)first; v<(long)(2*first); v++) {
+	size_t t=cases[v],a=0;
+	if (t>0) {
+	  philox g(seed,stream);
+	  g.jump(v);
+	  a=split(v,t,g.unif());
+	  if (a==(size_t)-1) {
+	    failed=true;
+	    a=0;
+	  }
+	}
+	cases[2*v]=a;
+	cases[2*v+1]=t-a;
+      }
+    }
+    if (failed)
+      throw std::range_error("product tree underflow");
+    for (size_t i=0; i<q; i++)
+      res[i]=(int)cases[size+i];
+  }
+};
+
+}
+
+#endif
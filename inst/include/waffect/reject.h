@@ -0,0 +1,62 @@
+#ifndef _waffect_REJECT_H
+#define _waffect_REJECT_H
+
+#include <vector>
+#include "rng.h"
+#include "tilt.h"
+
+namespace waffect {
+
+/* uniforms drawn at once by the rejection sampler */
+const size_t REJECT_BLOCK=256;
+
+/* draw independent Bernoulli(pi[i]) until exactly r cases are obtained,
+ * return the number of passes. The pi are first tilted so that r cases are
+ * expected (see tilt.h), which does not change the result but makes a pass
+ * succeed with probability about 1/sqrt(2*pi*sum pi'(1-pi')). The draws are
+ * made by blocks of REJECT_BLOCK uniforms, and a pass is abandoned after a
+ * block as soon as it has more than r cases or cannot reach r anymore. */
+template <class RNG>
+size_t reject(const double *pi,size_t q,size_t r,int *res,RNG &g) {
+  double logtheta=tilt(pi,q,r);
+  std::vector<double> p(q);
+  // reach[b]: individuals which may be cases from block b on
+  size_t nblocks=(q+REJECT_BLOCK-1)/REJECT_BLOCK;
+  std::vector<size_t> reach(nblocks+1,0);
+  for (size_t i=0; i<q; i++)
+    p[i]=tilted(pi[i],logtheta);
+  for (size_t b=nblocks; b-- >0; ) {
+    reach[b]=reach[b+1];
+    for (size_t i=b*REJECT_BLOCK; i<q && i<(b+1)*REJECT_BLOCK; i++)
+      reach[b]+=p[i]>0.0;
+  }
+
+  double u[REJECT_BLOCK];
+  size_t passes=0;
+  for (;;) {
+    passes++;
+    size_t ncases=0,b=0;
+    for (; b<nblocks; b++) {
+      size_t first=b*REJECT_BLOCK;
+      size_t len=first+REJECT_BLOCK<=q ? REJECT_BLOCK : q-first;
+      for (size_t k=0; k<len; k++)
+	u[k]=g.unif();
+      // branch free, vectorizable
+      size_t n=0;
+      for (size_t k=0; k<len; k++) {
+	int x=u[k]<p[first+k];
+	res[first+k]=x;
+	n+=x;
+      }
+      ncases+=n;
+      if (ncases>r || ncases+reach[b+1]<r)
+	break;
+    }
+    if (b==nblocks && ncases==r)
+      return passes;
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef _waffect_RNG_H
+#define _waffect_RNG_H
+
+#include <stdint.h>
+#include <cmath>
+
+namespace waffect {
+
+/*
+ * Random number generators. Any class with
+ *   double unif();          // uniform in [0,1)
+ *   size_t index(size_t n); // uniform in {0,...,n-1}
+ * can be used by the samplers (see rrng in waffect.h for R's generator).
+ */
+
+/* Philox4x32-10 counter based generator (Salmon et al., SC'11). The output
+ * is a pure function of (seed, stream, position): stream k of a given seed
+ * is independent of the others and can be started anywhere in O(1). */
+class philox {
+private:
+  uint32_t key[2];
+  uint32_t ctr[4];   // ctr[0..1]: block position, ctr[2..3]: stream
+  uint32_t out[4];
+  int used;
+
+  static inline void mulhilo(uint32_t a,uint32_t b,uint32_t &hi,uint32_t &lo) {
+    uint64_t p=(uint64_t)a*(uint64_t)b;
+    hi=(uint32_t)(p>>32);
+    lo=(uint32_t)p;
+  }
+
+  void block() {
+    uint32_t c0=ctr[0],c1=ctr[1],c2=ctr[2],c3=ctr[3];
+    uint32_t k0=key[0],k1=key[1];
+    for (int round=0; round<10; round++) {
+      uint32_t hi0,lo0,hi1,lo1;
+      mulhilo(0xD2511F53u,c0,hi0,lo0);
+      mulhilo(0xCD9E8D57u,c2,hi1,lo1);
+      c0=hi1^c1^k0;
+      c1=lo1;
+      c2=hi0^c3^k1;
+      c3=lo0;
+      k0+=0x9E3779B9u;
+      k1+=0xBB67AE85u;
+    }
+    out[0]=c0; out[1]=c1; out[2]=c2; out[3]=c3;
+    // next block
+    if (++ctr[0]==0)
+      ++ctr[1];
+    used=0;
+  }
+
+public:
+  philox(uint64_t seed,uint64_t stream=0) {
+    key[0]=(uint32_t)seed;
+    key[1]=(uint32_t)(seed>>32);
+    ctr[2]=(uint32_t)stream;
+    ctr[3]=(uint32_t)(stream>>32);
+    jump(0);
+  }
+
+  /* restart the stream at block pos (each block is 4 32-bit words) */
+  void jump(uint64_t pos) {
+    ctr[0]=(uint32_t)pos;
+    ctr[1]=(uint32_t)(pos>>32);
+    used=4;
+  }
+
+  /* switch to another stream of the same seed, from its beginning */
+  void stream(uint64_t s) {
+    ctr[2]=(uint32_t)s;
+    ctr[3]=(uint32_t)(s>>32);
+    jump(0);
+  }
+
+  uint32_t next() {
+    if (used==4)
+      block();
+    return out[used++];
+  }
+
+  /* 53 random bits */
+  double unif() {
+    uint32_t a=next()>>5,b=next()>>6;
+    return (a*67108864.0+b)*(1.0/9007199254740992.0);
+  }
+
+  /* unbiased integer in [0,n) (Lemire's multiply and reject) */
+  size_t index(size_t n) {
+    if (n>0xFFFFFFFFu)
+      return (size_t)floor(unif()*(double)n);
+    uint32_t s=(uint32_t)n;
+    uint64_t m=(uint64_t)next()*s;
+    uint32_t l=(uint32_t)m;
+    if (l<s) {
+      uint32_t t=(uint32_t)(-s)%s;
+      while (l<t) {
+	m=(uint64_t)next()*s;
+	l=(uint32_t)m;
+      }
+    }
+    return (size_t)(m>>32);
+  }
+};
+
+/* return true with probability prob, false else */
+template <class RNG>
+inline bool draw(RNG &g,double prob) {
+  return g.unif()<prob;
+};
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef _waffect_SAMPLER_H
+#define _waffect_SAMPLER_H
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "xdouble.h"
+#include "btable.h"
+#include "rng.h"
+#include "backward.h"
+
+namespace waffect {
+
+/* backward table computed once for a given (pi,r), reused for every draw;
+ * B is used with xdouble cells, S with row-scaled double cells (pi is then
+ * tilted, see table_pi), discarded is the mass dropped by the truncation
+ * (tol>0) */
+struct sampler {
+  std::vector<double> pi;
+  size_t r;
+  bool scaled;
+  double discarded;
+  btable<xdouble> B;
+  btable<double> S;
+
+  sampler(const double *ppi,size_t qq,size_t rr,bool sscaled,double tol) : pi(ppi,ppi+qq), r(rr), scaled(sscaled), discarded(0.0) {
+    size_t q=pi.size();
+    if (r>q)
+      throw std::invalid_argument("more cases than individuals");
+    if (scaled) {
+      std::vector<double> p;
+      table_pi<double>(&pi[0],q,r,p);
+      pi.swap(p);
+      S.resize(q,r+2);
+      backward(r,q,0,&pi[0],q,S,tol,&discarded);
+    } else {
+      B.resize(q,r+2);
+      backward(r,q,0,&pi[0],q,B,tol,&discarded);
+    }
+  }
+
+  template <class RNG>
+  void sample(int *res,RNG &g) {
+    if (scaled)
+      forward(&pi[0],pi.size(),S,res,g);
+    else
+      forward(&pi[0],pi.size(),B,res,g);
+  }
+
+  /* nsim replicates (columns of res) on nthreads threads, replicate k from
+   * stream first+k of seed */
+  void batch(int *res,size_t nsim,uint64_t seed,int nthreads,size_t first=0) {
+    size_t q=pi.size();
+    bool failed=false;
+    std::string what;
+
+    // the table is only read, each replicate has its own stream: the result
+    // does not depend on the number of threads
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic,1)
+#endif
+    for (long k=0; k<(long)nsim; k++) {
+      philox g(seed,first+k);
+      try {
+	sample(res+k*q,g);
+      } catch (std::exception &e) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+	{
+	  failed=true;
+	  what=e.what();
+	}
+      }
+    }
+    if (failed)
+      throw std::range_error(what);
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef _waffect_STORE_H
+#define _waffect_STORE_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <stdint.h>
+#include "packed.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace waffect {
+
+/*
+ * Replicate store: a file with a header of 64 bytes followed by one
+ * bit-packed column (packed.h) of stride bytes per replicate, in the byte
+ * order of the machine. Replicate k was drawn from stream k of the seed, so
+ * that a store can be extended later with the same replicates as if they
+ * had been drawn at once; hash identifies (pi,r) and method the engine
+ * (method="auto" resolved, since the plan depends on the number of
+ * replicates). The columns are written
+ * before the count of the header, which a reader takes as the number of
+ * valid columns: a store can be read while it is being written, and a store
+ * whose writer was interrupted ends with its last complete block.
+ */
+struct store_header {
+  char magic[8];          // "WAFFECT" and the version
+  uint64_t individuals;   // rows of the replicates
+  uint64_t cases;         // cases per replicate
+  uint64_t count;         // complete replicates
+  uint64_t stride;        // bytes per column
+  uint64_t seed;          // replicate k from stream k of seed
+  uint64_t hash;          // of pi and r
+  uint64_t method;        // engine of the replicates (planner.h code)
+};
+
+static const char store_magic[8]={'W','A','F','F','E','C','T',1};
+
+/* FNV-1a hash of pi and r */
+inline uint64_t store_hash(const double *pi,size_t q,size_t r) {
+  uint64_t h=14695981039346656037ULL;
+  const unsigned char *b=reinterpret_cast<const unsigned char *>(pi);
+  for (size_t k=0; k<q*sizeof(double); k++)
+    h=(h^b[k])*1099511628211ULL;
+  return (h^(uint64_t)r)*1099511628211ULL;
+};
+
+inline void store_seek(FILE *f,uint64_t at) {
+#ifdef _WIN32
+  int err=_fseeki64(f,(long long)at,SEEK_SET);
+#else
+  int err=fseeko(f,(off_t)at,SEEK_SET);
+#endif
+  if (err)
+    throw std::runtime_error("cannot seek in the replicate store");
+};
+
+inline store_header store_read_header(FILE *f,const std::string &file) {
+  store_header h;
+  if (fread(&h,sizeof(h),1,f)!=1 || memcmp(h.magic,store_magic,8)!=0)
+    throw std::invalid_argument(file+" is not a replicate store");
+  if (h.stride!=packed_bytes(h.individuals))
+    throw std::invalid_argument(file+" is a corrupted replicate store");
+  return h;
+};
+
+/* length of the file, to be checked against the count of its header */
+inline uint64_t store_length(FILE *f) {
+#ifdef _WIN32
+  bool ok=_fseeki64(f,0,SEEK_END)==0;
+  long long at=ok ? _ftelli64(f) : -1;
+#else
+  bool ok=fseeko(f,0,SEEK_END)==0;
+  off_t at=ok ? ftello(f) : -1;
+#endif
+  if (at<0)
+    throw std::runtime_error("cannot seek in the replicate store");
+  return (uint64_t)at;
+};
+
+/* appends replicates to a new or existing store; a store that is replaced
+ * is written next to it (file.part) and renamed over it by close(), so that
+ * it survives a writer that fails or is interrupted */
+class store_writer {
+  FILE *f;
+  std::string file,part;
+
+  store_writer(const store_writer &);
+  store_writer &operator=(const store_writer &);
+
+public:
+  store_header header;
+
+  /* a new store (append=false) or the end of an existing one, which must
+   * hold replicates of the same (pi,r) drawn by the same engine */
+  store_writer(const std::string &ffile,size_t q,size_t r,uint64_t seed,uint64_t hash,int method,bool append) : f(0), file(ffile) {
+    if (append)
+      f=fopen(file.c_str(),"r+b");
+    if (f) {
+      header=store_read_header(f,file);
+      if (header.individuals!=q || header.cases!=r || header.hash!=hash) {
+	fclose(f);
+	throw std::invalid_argument(file+" holds replicates of another model");
+      }
+      if (header.method!=(uint64_t)method) {
+	fclose(f);
+	throw std::invalid_argument(file+" was drawn with another method");
+      }
+      if (store_length(f)<sizeof(header)+header.count*header.stride) {
+	fclose(f);
+	throw std::runtime_error(file+" is a truncated replicate store");
+      }
+      return;
+    }
+    FILE *old=fopen(file.c_str(),"rb");
+    if (old) {
+      fclose(old);
+      part=file+".part";
+    }
+    f=fopen((part.empty() ? file : part).c_str(),"w+b");
+    if (!f)
+      throw std::runtime_error("cannot open "+(part.empty() ? file : part));
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,store_magic,8);
+    header.individuals=q;
+    header.cases=r;
+    header.stride=packed_bytes(q);
+    header.seed=seed;
+    header.hash=hash;
+    header.method=method;
+    write_header();
+  }
+
+  ~store_writer() {
+    if (f)
+      fclose(f);
+    if (!part.empty())
+      remove(part.c_str());
+  }
+
+  void write_header() {
+    store_seek(f,0);
+    if (fwrite(&header,sizeof(header),1,f)!=1 || fflush(f)!=0)
+      throw std::runtime_error("cannot write "+(part.empty() ? file : part));
+  }
+
+  /* nsim packed columns, then the new count */
+  void append(const unsigned char *cols,size_t nsim) {
+    store_seek(f,sizeof(header)+header.count*header.stride);
+    if (fwrite(cols,header.stride,nsim,f)!=nsim || fflush(f)!=0)
+      throw std::runtime_error("cannot write "+(part.empty() ? file : part));
+    header.count+=nsim;
+    write_header();
+  }
+
+  void close() {
+    int err=fclose(f);
+    f=0;
+    if (err)
+      throw std::runtime_error("cannot write "+(part.empty() ? file : part));
+    if (part.empty())
+      return;
+#ifdef _WIN32
+    remove(file.c_str());
+#endif
+    if (rename(part.c_str(),file.c_str())!=0)
+      throw std::runtime_error("cannot replace "+file);
+    part.clear();
+  }
+};
+
+/* read-only view of the complete replicates of a store when it is opened:
+ * the file is mapped in memory and column(k) points into the mapping
+ * (without mmap, on Windows, the columns are read in a buffer) */
+class store_reader {
+  const unsigned char *base;
+  size_t length;
+  std::vector<unsigned char> buf;
+
+  store_reader(const store_reader &);
+  store_reader &operator=(const store_reader &);
+
+public:
+  store_header header;
+
+  store_reader(const std::string &file) : base(0), length(0) {
+    FILE *f=fopen(file.c_str(),"rb");
+    if (!f)
+      throw std::runtime_error("cannot open "+file);
+    try {
+      header=store_read_header(f,file);
+    } catch (...) {
+      fclose(f);
+      throw;
+    }
+    length=sizeof(header)+header.count*header.stride;
+#ifdef _WIN32
+    buf.resize(length);
+    store_seek(f,0);
+    bool ok=fread(&buf[0],1,length,f)==length;
+    fclose(f);
+    if (!ok)
+      throw std::runtime_error("cannot read "+file);
+    base=&buf[0];
+#else
+    fclose(f);
+    int fd=open(file.c_str(),O_RDONLY);
+    if (fd<0)
+      throw std::runtime_error("cannot open "+file);
+    // a mapping beyond the end of the file would fault on access
+    struct stat st;
+    if (fstat(fd,&st)!=0 || (uint64_t)st.st_size<length) {
+      ::close(fd);
+      throw std::runtime_error(file+" is a truncated replicate store");
+    }
+    void *p=mmap(0,length,PROT_READ,MAP_SHARED,fd,0);
+    ::close(fd);
+    if (p==MAP_FAILED)
+      throw std::runtime_error("cannot map "+file);
+    base=static_cast<const unsigned char *>(p);
+#endif
+  }
+
+  ~store_reader() {
+#ifndef _WIN32
+    if (base)
+      munmap(const_cast<unsigned char *>(base),length);
+#endif
+  }
+
+  size_t individuals() const { return header.individuals; }
+  size_t size() const { return header.count; }
+
+  /* packed column of replicate k (0-based) */
+  const unsigned char *column(size_t k) const {
+    if (k>=header.count)
+      throw std::out_of_range("replicate not in the store");
+    return base+sizeof(header)+k*header.stride;
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef _waffect_TILT_H
+#define _waffect_TILT_H
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+
+namespace waffect {
+
+/*
+ * Exponential tilting. Replacing every pi_i by
+ *   pi_i' = pi_i*theta/(1-pi_i+pi_i*theta)
+ * multiplies the probability of any configuration with r cases by
+ * theta^r/prod(1-pi_i+pi_i*theta): the distribution conditional on r cases
+ * is unchanged. tilt() returns log(theta) such that sum(pi') = r, the
+ * individuals with pi in {0,1} being left aside (they are fixed).
+ * With mult non null, pi[i] stands for mult[i] individuals.
+ */
+inline double tilt(const double *pi,const size_t *mult,size_t q,size_t r) {
+  std::vector<double> logit,weight;
+  size_t ones=0,free=0;
+  for (size_t i=0; i<q; i++) {
+    size_t n=mult ? mult[i] : 1;
+    if (pi[i]>=1.0) {
+      ones+=n;
+    } else if (pi[i]>0.0) {
+      logit.push_back(log(pi[i])-log1p(-pi[i]));
+      weight.push_back((double)n);
+      free+=n;
+    }
+  }
+  if (r<ones || r>ones+free)
+    throw std::invalid_argument("the number of cases is not compatible with the probabilities");
+  double target=(double)(r-ones);
+  if (target==0.0 || target==(double)free)
+    return 0.0;   // every free individual is fixed by the count, any theta
+
+  // f(t)=sum sigmoid(logit_i+t)-target is increasing: Newton's method
+  // safeguarded by bisection on [lo,hi]
+  double lo=-800.0,hi=800.0,t=0.0;
+  for (int iter=0; iter<200; iter++) {
+    double f=-target,df=0.0;
+    for (size_t i=0; i<logit.size(); i++) {
+      double x=logit[i]+t;
+      double s=x>=0 ? 1.0/(1.0+exp(-x)) : exp(x)/(1.0+exp(x));
+      f+=weight[i]*s;
+      df+=weight[i]*s*(1.0-s);
+    }
+    if (f>0.0)
+      hi=t;
+    else
+      lo=t;
+    if (fabs(f)<1e-10*(1.0+target))
+      break;
+    double next=df>0.0 ? t-f/df : 0.5*(lo+hi);
+    if (!(next>lo && next<hi))
+      next=0.5*(lo+hi);
+    if (fabs(next-t)<1e-15*(1.0+fabs(t)))
+      break;
+    t=next;
+  }
+  return t;
+};
+
+/* every pi[i] for a single individual */
+inline double tilt(const double *pi,size_t q,size_t r) {
+  return tilt(pi,0,q,r);
+};
+
+/* log prod(1-pi_i+pi_i*theta): a configuration with r cases has the
+ * log-probability of the tilted pi, minus r*log(theta), plus this */
+inline double tilt_norm(const double *pi,size_t q,double logtheta) {
+  double s=0.0;
+  for (size_t i=0; i<q; i++)
+    s+=logtheta>0.0 ? logtheta+log(pi[i]+(1.0-pi[i])*exp(-logtheta)) : log1p(pi[i]*expm1(logtheta));
+  return s;
+};
+
+/* pi'=pi*theta/(1-pi+pi*theta) with logtheta=log(theta), written in the
+ * logit scale to avoid overflows */
+inline double tilted(double pi,double logtheta) {
+  if (pi<=0.0 || pi>=1.0)
+    return pi;
+  double x=log(pi)-log1p(-pi)+logtheta;
+  return x>=0 ? 1.0/(1.0+exp(-x)) : exp(x)/(1.0+exp(x));
+};
+
+}
+
+#endif
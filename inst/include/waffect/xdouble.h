@@ -35,6 +35,16 @@
 #define NTL_MAX_INT (2147483647)
 #define NTL_MIN_INT  (-NTL_MAX_INT - 1)
 
+namespace waffect {
+
+// the <math.h> functions stay visible next to their xdouble overloads
+using ::sqrt;
+using ::trunc;
+using ::floor;
+using ::ceil;
+using ::fabs;
+using ::log;
+
 
 
 
@@ -1056,5 +1066,6 @@ inline xdouble MulSub(const xdouble& a, const xdouble& b,
                             const xdouble& c)
    { xdouble z; MulSub(z, a, b, c); return z; }
 
+}
 
 #endif 
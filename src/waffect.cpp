@@ -7,203 +7,749 @@ using std::cout;
 using std::endl;
 
 using namespace Rcpp;
+using namespace waffect;
 
 
-bool draw(xdouble prob) {
-  if ((xdouble)rand()/(xdouble)RAND_MAX<prob)
-    return true;
-  else
-    return false;
+/* true when rseed asks for R's own generator (NULL or NA) */
+bool rseeded(SEXP rseed) {
+  return Rf_isNull(rseed) || ISNAN(Rf_asReal(rseed));
 };
 
-bool draw(double prob) {
-  if ((double)rand()/(double)RAND_MAX<prob)
-    return true;
-  else
-    return false;
+uint64_t seedvalue(SEXP rseed) {
+  return (uint64_t)Rf_asReal(rseed);
 };
 
-//size_t backward(size_t r,size_t h,size_t j,Rcpp::RcppVector<xdouble> &pi,std::vector<std::vector<xdouble> > &B) {
-size_t backward(size_t r,size_t h,size_t j,NumericVector &pi,vector<vector<xdouble> > &B) {
-  size_t q=pi.size();
-  size_t currentpos,previouspos;
-  currentpos=h-1;
-
-  // initialize B
-  for (size_t i=0; i<h; i++)
-    for (size_t m=0; m<=r+1; m++) {
-      B[i][m]=0.0;
-    }
-  B[h-1][r]=1.0;
-
-  for (size_t i=q-2; i!=j-1; i--) {
-    //cout<<"i="<<i<<endl;
-    // update circular positions
-    previouspos=currentpos;
-    currentpos--;
-    if (currentpos==-1)
-      currentpos+=h;
-    //cout<<"previouspos="<<previouspos<<" currentpos="<<currentpos<<endl;
-    // update B
-    for (size_t m=0; m<=r; m++)
-		B[currentpos][m]=pi[i+1]*B[previouspos][m+1]+(1.0-pi[i+1])*B[previouspos][m];    
-  }
-  return currentpos;
+uint64_t streamseed(SEXP rseed) {
+  if (!rseeded(rseed))
+    return seedvalue(rseed);
+  RNGScope scope;
+  uint64_t hi=(uint64_t)(unif_rand()*4294967296.0);
+  uint64_t lo=(uint64_t)(unif_rand()*4294967296.0);
+  return (hi<<32)|lo;
 };
 
-void print(vector<vector<xdouble> > &B) {
-  //for (size_t i=0; i<B.size(); i++) {
+void print(btable<xdouble> &B) {
+  //for (size_t i=0; i<B.nrow(); i++) {
     //cout<<"B["<<i<<"]: ";
-    //for (size_t m=0; m<B[i].size(); m++)
+    //for (size_t m=0; m<B.ncol(); m++)
       //cout<<B[i][m]<<" ";
     //cout<<endl;
   //}
 };
 
-SEXP waffectbin(SEXP rpi, SEXP rr, SEXP rh) {
-	
+SEXP waffectbin(SEXP rpi, SEXP rr, SEXP rbudget, SEXP rscaled, SEXP rtol, SEXP rseed) {
+BEGIN_RCPP
   NumericVector pi(rpi);
   size_t r=*INTEGER(rr);
-  size_t h=*INTEGER(rh);
+  double budget=*REAL(rbudget);
+  bool scaled=*LOGICAL(rscaled);
+  double tol=*REAL(rtol);
   size_t q=pi.size();
   LogicalVector res(q);
 
-  // min size for h is 2, if lower, q by default
-  if (h<1) {
-    h=q;
-  };
-
-  // allocate B size h x (r+2)
-  vector<vector<xdouble> > B;
-  { 
-    vector<xdouble> tmp(r+2);
-    for (size_t i=0; i<h; i++)
-      B.push_back(tmp);
-  }
-
-  // compute B0 ... Bh
-  size_t currentpos=backward(r,h,0,pi,B);
-  size_t largest=h-1;
-
-  size_t N=0;
-  size_t i=0;
-
-
-  //sample res[0]
-  {
-    xdouble prob0,prob1;
-    prob0=(1.0-pi[0])*B[currentpos][0];
-    prob1=pi[0]*B[currentpos][1];
-    
-    res[0]=draw(prob1/(prob0+prob1));
-    
-    if (res[0])
-      N++;
-    i++;
-  }
-
-  // main loop
-  size_t previouspos;
-  while (i<q) {
-    // update B if needed
-    if (i>largest) {
-      currentpos=backward(r,h,i,pi,B);
-      largest=i+h-1;
-      
-      xdouble prob0,prob1;
-      prob0=(1.0-pi[i])*B[currentpos][N];
-      prob1=pi[i]*B[currentpos][N+1];
-    
-      res[i]=draw(prob1/(prob0+prob1));
-        
-      if (res[i])
-	N++;
-      i++;
-      
+  // budget in bytes for the backward table, non finite or <=0 for no limit
+  binopt opt=waffect::options(waffect::BACKWARD);
+  opt.scaled=scaled;
+  opt.budget=R_FINITE(budget) ? budget : 0.0;
+  opt.tol=tol;
+
+  double discarded;
+  if (rseeded(rseed)) {
+    RNGScope scope;
+    rrng g;
+    discarded=waffect::sample(pi,r,res,g,opt);
+  } else {
+    philox g(seedvalue(rseed));
+    discarded=waffect::sample(pi,r,res,g,opt);
+  }
+
+  if (tol>0.0)
+    res.attr("discarded")=discarded;
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffectbin_prepare(SEXP rpi, SEXP rr, SEXP rscaled, SEXP rtol) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  bool scaled=*LOGICAL(rscaled);
+  double tol=*REAL(rtol);
+
+  XPtr<sampler> ptr(new sampler(pi.begin(),pi.size(),r,scaled,tol),true);
+  if (tol>0.0)
+    ptr.attr("discarded")=ptr->discarded;
+  return ptr;
+END_RCPP
+};
+
+SEXP waffectbin_sample(SEXP rsampler, SEXP rnsim, SEXP rseed, SEXP rthreads) {
+BEGIN_RCPP
+  XPtr<sampler> s(rsampler);
+  size_t nsim=*INTEGER(rnsim);
+  int nthreads=*INTEGER(rthreads);
+  size_t q=s->pi.size();
+  LogicalMatrix res(q,nsim);
+
+  // replicate k is stream k of the seed (drawn from R's generator if NULL)
+  s->batch(&res[0],nsim,streamseed(rseed),nthreads);
+
+  return res;
+END_RCPP
+};
+
+SEXP waffect_dynamic(SEXP rpi, SEXP rr, SEXP rthreads) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  int nthreads=*INTEGER(rthreads);
+
+  // product tree, updated in place by waffect_dynamic_update
+  XPtr<generator> ptr(new generator(pi.begin(),pi.size(),r,FFT,true,0.0,1,nthreads),true);
+  return ptr;
+END_RCPP
+};
+
+SEXP waffect_dynamic_update(SEXP rgen, SEXP rj, SEXP rpi, SEXP rthreads) {
+BEGIN_RCPP
+  XPtr<generator> G(rgen);
+  IntegerVector j(rj);
+  NumericVector pi(rpi);
+  if (j.size()!=pi.size())
+    throw std::invalid_argument("one probability per individual is needed");
+
+  // individuals are 1-based in R
+  std::vector<size_t> idx(j.size());
+  for (size_t k=0; k<idx.size(); k++) {
+    if (j[k]<1 || (size_t)j[k]>G->individuals())
+      throw std::invalid_argument("individual not in the sampler");
+    idx[k]=j[k]-1;
+  }
+  G->update(idx.size()>0 ? &idx[0] : 0,pi.begin(),idx.size(),*INTEGER(rthreads));
+  return R_NilValue;
+END_RCPP
+};
+
+SEXP waffect_dynamic_sample(SEXP rgen, SEXP rnsim, SEXP rseed, SEXP rthreads, SEXP rpacked) {
+BEGIN_RCPP
+  XPtr<generator> G(rgen);
+  size_t nsim=*INTEGER(rnsim);
+  int nthreads=*INTEGER(rthreads);
+  size_t q=G->individuals();
+  uint64_t seed=streamseed(rseed);
+
+  // replicate k is stream k of the seed, as for waffectbin_packed
+  if (*LOGICAL(rpacked)) {
+    RawMatrix res(packed_bytes(q),nsim);
+    G->block_packed(&res[0],0,nsim,seed,nthreads);
+    res.attr("individuals")=(double)q;
+    return res;
+  }
+  LogicalMatrix res(q,nsim);
+  G->block(&res[0],0,nsim,seed,nthreads);
+  return res;
+END_RCPP
+};
+
+SEXP waffectbin_batch(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rmethod, SEXP rscaled, SEXP rbudget, SEXP rtol, SEXP rseed, SEXP rthreads) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  size_t nsim=*INTEGER(rnsim);
+  int method=*INTEGER(rmethod);
+  bool scaled=*LOGICAL(rscaled);
+  double budget=*REAL(rbudget);
+  double tol=*REAL(rtol);
+  int nthreads=*INTEGER(rthreads);
+  size_t q=pi.size();
+  LogicalMatrix res(q,nsim);
+  uint64_t seed=streamseed(rseed);
+  if (!R_FINITE(budget))
+    budget=0.0;
+
+  // replicate k is stream k of the seed
+  if (tol>0.0) {
+    // the truncated table is only kept whole
+    size_t row=scaled ? btable<double>::rowbytes(r+2) : btable<xdouble>::rowbytes(r+2);
+    if (method!=BACKWARD || (budget>0.0 && (double)q*row>budget))
+      throw std::invalid_argument("tol > 0 with nsim > 1 needs method \"backward\" and a budget for the whole table");
+    sampler s(pi.begin(),q,r,scaled,tol);
+    s.batch(&res[0],nsim,seed,nthreads);
+    res.attr("discarded")=s.discarded;
+    return res;
+  }
+  generator G(pi.begin(),q,r,method,scaled,budget,nsim,nthreads);
+  G.block(&res[0],0,nsim,seed,nthreads);
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffectbin_fft(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rseed, SEXP rthreads) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  size_t nsim=*INTEGER(rnsim);
+  int nthreads=*INTEGER(rthreads);
+  size_t q=pi.size();
+  LogicalMatrix res(q,nsim);
+  uint64_t seed=streamseed(rseed);
+
+  ptree T(pi.begin(),q,r,nthreads);
+  if (nsim==1) {
+    // a single replicate: the levels of the tree are shared among the threads
+    std::vector<size_t> cases;
+    T.sample(&res[0],seed,0,cases,nthreads);
+  } else {
+    // replicate k is stream k of the seed
+    bool failed=false;
+    std::string what;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic,1)
+#endif
+    for (long k=0; k<(long)nsim; k++) {
+      std::vector<size_t> cases;
+      try {
+	T.sample(&res[k*q],seed,k,cases);
+      } catch (std::exception &e) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+	{
+	  failed=true;
+	  what=e.what();
+	}
+      }
     }
-    if (i<=largest) {
-      // update circular position
-      previouspos=currentpos;
-      currentpos++;
-      if (currentpos>h-1)
-	currentpos-=h;
-      
-      res[i]=draw(pi[i]*B[currentpos][N+1]/B[previouspos][N]);
-      // update N
-      if (res[i])
-	N++;
-      // update i
-      i++;
+    if (failed)
+      throw std::range_error(what);
+  }
+
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffectbin_grouped(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rseed, SEXP rthreads) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  size_t nsim=*INTEGER(rnsim);
+  int nthreads=*INTEGER(rthreads);
+  size_t q=pi.size();
+  LogicalMatrix res(q,nsim);
+  uint64_t seed=streamseed(rseed);
+
+  grouped G(pi.begin(),q,r);
+  bool failed=false;
+  std::string what;
+
+  // replicate k is stream k of the seed
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic,1)
+#endif
+  for (long k=0; k<(long)nsim; k++) {
+    philox g(seed,k);
+    std::vector<size_t> work;
+    try {
+      G.sample(&res[k*q],g,work);
+    } catch (std::exception &e) {
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+      {
+	failed=true;
+	what=e.what();
+      }
     }
   }
-  
+  if (failed)
+    throw std::range_error(what);
+
+  res.attr("groups")=(int)G.ngroups();
   return res;
+END_RCPP
 };
 
 
 
-SEXP waffectbin_mcmc(SEXP rpi, SEXP rr, SEXP rburnin) {
-	
+SEXP waffectbin_mcmc(SEXP rpi, SEXP rr, SEXP rburnin, SEXP rthin, SEXP rnsim, SEXP rweighted, SEXP rseed) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  double burnin=*REAL(rburnin);
+  size_t nsim=*INTEGER(rnsim);
+  size_t q=pi.size();
+  LogicalMatrix res(q,nsim);
+
+  // burnin NA or 0: automatic, at most 10000 sweeps of q steps
+  mcmcopt opt;
+  opt.burnin=ISNAN(burnin) ? 0 : (size_t)burnin;
+  opt.maxburnin=10000*q;
+  opt.thin=(size_t)*REAL(rthin);
+  opt.weighted=*LOGICAL(rweighted);
+
+  mcmcinfo info;
+  if (rseeded(rseed)) {
+    RNGScope scope;
+    rrng g;
+    info=mcmc_run(pi.begin(),q,r,opt,&res[0],nsim,g);
+  } else {
+    philox g(seedvalue(rseed));
+    info=mcmc_run(pi.begin(),q,r,opt,&res[0],nsim,g);
+  }
+
+  res.attr("burnin")=(double)info.burnin;
+  res.attr("converged")=info.converged;
+  res.attr("acceptance")=info.acceptance;
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffectbin_mchain(SEXP rpi, SEXP rr, SEXP rburnin, SEXP rthin, SEXP rnsim, SEXP rweighted, SEXP rchains, SEXP rseed, SEXP rthreads) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  double burnin=*REAL(rburnin);
+  size_t nsim=*INTEGER(rnsim);
+  size_t nchains=*INTEGER(rchains);
+  int nthreads=*INTEGER(rthreads);
+  size_t q=pi.size();
+  LogicalMatrix res(q,nsim*nchains);
+
+  mcmcopt opt;
+  opt.burnin=ISNAN(burnin) ? 0 : (size_t)burnin;
+  opt.maxburnin=10000*q;
+  opt.thin=(size_t)*REAL(rthin);
+  opt.weighted=*LOGICAL(rweighted);
+
+  // chain c is stream c of the seed
+  mchaininfo info=mchain_run(pi.begin(),q,r,opt,nchains,&res[0],nsim,streamseed(rseed),nthreads);
+
+  IntegerVector chain(nsim*nchains);
+  for (size_t k=0; k<nsim*nchains; k++)
+    chain[k]=k/nsim+1;
+  res.attr("chain")=chain;
+  res.attr("burnin")=(double)info.burnin;
+  res.attr("converged")=info.converged;
+  res.attr("rhat")=NumericVector(info.rhat.begin(),info.rhat.end());
+  res.attr("acceptance")=NumericVector(info.acceptance.begin(),info.acceptance.end());
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffectbin_reject(SEXP rpi, SEXP rr, SEXP rseed) {
+BEGIN_RCPP
   NumericVector pi(rpi);
   size_t r=*INTEGER(rr);
-  size_t burnin=*INTEGER(rburnin);
   size_t q=pi.size();
   LogicalVector res(q);
 
-  vector<size_t> cases,controls;
-
-  // start with a valid configuration
-  for (int i=0; i<r; i++) {
-    res[i]=true;
-    cases.push_back(i);
-  }
-  for (int i=r; i<q; i++) {
-    res[i]=false;
-    controls.push_back(i);
-  }
-
-  for (int iter=0; iter<burnin; iter++) {
-    // propose move
-    int pos0=floor((double)rand()/(double)RAND_MAX*(double)(q-r));
-    int pos1=floor((double)rand()/(double)RAND_MAX*(double)r);
-    int i1=cases[pos1];
-    int i0=controls[pos0];
-
-    // compute accept ratio
-    double alpha=pi[i0]*(1.0-pi[i1])/(pi[i1]*(1.0-pi[i0]));
-    
-    if (draw(alpha)) {
-      // accept move
-      cases[pos1]=i0;
-      controls[pos0]=i1;
-      res[i0]=true;
-      res[i1]=false;
+  size_t passes;
+  if (rseeded(rseed)) {
+    RNGScope scope;
+    rrng g;
+    passes=reject(pi.begin(),q,r,&res[0],g);
+  } else {
+    philox g(seedvalue(rseed));
+    passes=reject(pi.begin(),q,r,&res[0],g);
+  }
+
+  res.attr("passes")=(double)passes;
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffectbin_plan(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rbudget) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  size_t nsim=*INTEGER(rnsim);
+  double budget=*REAL(rbudget);
+  if (!R_FINITE(budget))
+    budget=0.0;
+
+  static const char *name[PLAN_ENGINES]={"backward","fft","grouped","reject"};
+  plan p=make_plan(pi.begin(),pi.size(),r,nsim,budget);
+
+  return List::create(Named("method")=std::string(name[p.engine]),
+		      Named("cost")=NumericVector(p.cost,p.cost+PLAN_ENGINES),
+		      Named("groups")=(double)p.groups,
+		      Named("variance")=p.variance);
+END_RCPP
+};
+
+SEXP waffect_marginal(SEXP rpi, SEXP rr, SEXP rscaled, SEXP rbudget) {
+BEGIN_RCPP
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  size_t q=pi.size();
+  double budget=*REAL(rbudget);
+  if (!R_FINITE(budget))
+    budget=0.0;
+
+  // forward-backward pass: P(Y_j=1 | sum=r) and log P(sum=r)
+  NumericVector res(q);
+  double logp;
+  if (*LOGICAL(rscaled))
+    logp=marginals<double>(r,pi.begin(),q,res.begin(),budget);
+  else
+    logp=marginals<xdouble>(r,pi.begin(),q,res.begin(),budget);
+  res.attr("logprob")=logp;
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffect_multiclass(SEXP rprob, SEXP rcount, SEXP rnsim, SEXP rmethod, SEXP rburnin, SEXP rweighted, SEXP rscaled, SEXP rbudget, SEXP rtol, SEXP rseed) {
+BEGIN_RCPP
+  NumericMatrix prob(rprob);
+  IntegerVector count(rcount);
+  size_t nsim=*INTEGER(rnsim);
+  size_t K=prob.nrow();
+  size_t n=prob.ncol();
+  IntegerMatrix res(n,nsim);
+
+  binopt opt;
+  opt.method=*INTEGER(rmethod);
+  opt.burnin=(size_t)*REAL(rburnin);
+  opt.weighted=*LOGICAL(rweighted);
+  opt.scaled=*LOGICAL(rscaled);
+  opt.budget=*REAL(rbudget);
+  opt.tol=*REAL(rtol);
+  if (!R_FINITE(opt.budget))
+    opt.budget=0.0;
+
+  double discarded=0.0;
+  if (rseeded(rseed)) {
+    RNGScope scope;
+    rrng g;
+    for (size_t k=0; k<nsim; k++)
+      discarded+=multiclass(prob.begin(),K,n,count.begin(),&res[k*n],g,opt);
+  } else {
+    // replicate k is stream k of the seed
+    philox g(seedvalue(rseed));
+    for (size_t k=0; k<nsim; k++) {
+      g.stream(k);
+      discarded+=multiclass(prob.begin(),K,n,count.begin(),&res[k*n],g,opt);
     }
+  }
 
-  };
-  
+  if (opt.tol>0.0)
+    res.attr("discarded")=discarded;
   return res;
+END_RCPP
 };
 
 
 
-SEXP waffectbin_reject(SEXP rpi, SEXP rr) {
-	
+SEXP waffectbin_packed(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rmethod, SEXP rscaled, SEXP rbudget, SEXP rseed, SEXP rthreads) {
+BEGIN_RCPP
   NumericVector pi(rpi);
   size_t r=*INTEGER(rr);
+  size_t nsim=*INTEGER(rnsim);
+  int nthreads=*INTEGER(rthreads);
+  double budget=*REAL(rbudget);
+  size_t q=pi.size();
+  size_t nbytes=packed_bytes(q);
+  RawMatrix res(nbytes,nsim);
+  uint64_t seed=streamseed(rseed);
+
+  // replicate k is stream k of the seed
+  generator G(pi.begin(),q,r,*INTEGER(rmethod),*LOGICAL(rscaled),R_FINITE(budget) ? budget : 0.0,nsim,nthreads);
+  G.block_packed(&res[0],0,nsim,seed,nthreads);
+
+  res.attr("individuals")=(double)q;
+  return res;
+END_RCPP
+};
+
+SEXP waffect_pack(SEXP rres) {
+BEGIN_RCPP
+  LogicalMatrix x(rres);
+  size_t q=x.nrow(),nsim=x.ncol();
+  size_t nbytes=packed_bytes(q);
+  RawMatrix res(nbytes,nsim);
+  for (size_t k=0; k<nsim; k++)
+    pack(&x[k*q],q,&res[k*nbytes]);
+  res.attr("individuals")=(double)q;
+  return res;
+END_RCPP
+};
+
+SEXP waffect_unpack(SEXP rx, SEXP rn, SEXP rcols) {
+BEGIN_RCPP
+  RawMatrix x(rx);
+  size_t q=(size_t)*REAL(rn);
+  IntegerVector cols(rcols);
+  size_t nbytes=packed_bytes(q);
+  LogicalMatrix res(q,cols.size());
+  for (size_t k=0; k<(size_t)cols.size(); k++) {
+    if (cols[k]<1 || cols[k]>x.ncol())
+      throw std::invalid_argument("column out of range");
+    unpack(&x[(cols[k]-1)*nbytes],q,&res[k*q]);
+  }
+  return res;
+END_RCPP
+};
+
+/* individuals to count, packed like the columns (empty if NULL: all) */
+std::vector<unsigned char> packedmask(SEXP rmask, size_t q) {
+  std::vector<unsigned char> mask;
+  if (!Rf_isNull(rmask)) {
+    LogicalVector m(rmask);
+    if ((size_t)m.size()!=q)
+      throw std::invalid_argument("one logical per individual is needed");
+    mask.resize(packed_bytes(q));
+    pack(m.begin(),q,&mask[0]);
+  }
+  return mask;
+};
+
+SEXP waffect_count(SEXP rx, SEXP rn, SEXP rmask) {
+BEGIN_RCPP
+  RawMatrix x(rx);
+  size_t q=(size_t)*REAL(rn);
+  size_t nbytes=packed_bytes(q),nsim=x.ncol();
+  IntegerVector res(nsim);
+
+  std::vector<unsigned char> mask=packedmask(rmask,q);
+  for (size_t k=0; k<nsim; k++)
+    res[k]=(int)packed_count(&x[k*nbytes],mask.empty() ? 0 : &mask[0],nbytes);
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffect_store(SEXP rfile, SEXP rpi, SEXP rr, SEXP rnsim, SEXP rmethod, SEXP rscaled, SEXP rbudget, SEXP rseed, SEXP rthreads, SEXP rappend) {
+BEGIN_RCPP
+  std::string file=CHAR(STRING_ELT(rfile,0));
+  NumericVector pi(rpi);
+  size_t r=*INTEGER(rr);
+  size_t nsim=*INTEGER(rnsim);
+  int nthreads=*INTEGER(rthreads);
+  double budget=*REAL(rbudget);
   size_t q=pi.size();
-  LogicalVector res(q);
 
-  size_t ncases=0;
+  // the engine is prepared (and its arguments checked) before the store is
+  // touched, and a replaced store is only renamed over the old one once
+  // complete: a failed call leaves an existing store as it was
+  generator G(pi.begin(),q,r,*INTEGER(rmethod),*LOGICAL(rscaled),R_FINITE(budget) ? budget : 0.0,nsim,nthreads);
+
+  // an existing store is extended with its own seed and engine: replicate k
+  // is always stream k of it
+  store_writer W(file,q,r,streamseed(rseed),store_hash(pi.begin(),q,r),G.method,*LOGICAL(rappend));
+  if (!rseeded(rseed) && seedvalue(rseed)!=W.header.seed)
+    throw std::invalid_argument(file+" was drawn with another seed");
+
+  // blocks of at most 64 MB, at least one replicate per thread
+  size_t stride=W.header.stride;
+  size_t block=std::max<size_t>((64u<<20)/stride,nthreads);
+  block=std::max<size_t>(1,std::min(block,nsim));
+  std::vector<unsigned char> buf(block*stride);
+  for (size_t done=0; done<nsim; done+=block) {
+    size_t m=std::min(block,nsim-done);
+    G.block_packed(&buf[0],W.header.count,m,W.header.seed,nthreads);
+    W.append(&buf[0],m);
+  }
+  W.close();
+
+  return waffect_store_info(rfile);
+END_RCPP
+};
 
-  while (ncases!=r) {
-    ncases=0;
-    for (size_t i=0; i<q; i++) {
-      res[i]=draw(pi[i]);
-      if (res[i])
-	ncases++;
+SEXP waffect_store_info(SEXP rfile) {
+BEGIN_RCPP
+  store_reader S(CHAR(STRING_ELT(rfile,0)));
+  return List::create(Named("individuals")=(double)S.individuals(),
+		      Named("cases")=(double)S.header.cases,
+		      Named("replicates")=(double)S.size());
+END_RCPP
+};
+
+SEXP waffect_store_read(SEXP rfile, SEXP rcols) {
+BEGIN_RCPP
+  store_reader S(CHAR(STRING_ELT(rfile,0)));
+  size_t stride=S.header.stride;
+
+  // the selected replicates (all if NULL), copied from the mapping
+  std::vector<size_t> cols;
+  if (Rf_isNull(rcols))
+    for (size_t k=0; k<S.size(); k++)
+      cols.push_back(k);
+  else {
+    IntegerVector c(rcols);
+    for (size_t k=0; k<(size_t)c.size(); k++) {
+      if (c[k]<1 || (size_t)c[k]>S.size())
+	throw std::invalid_argument("replicate not in the store");
+      cols.push_back(c[k]-1);
     }
-  };
-  
+  }
+  RawMatrix res(stride,cols.size());
+  for (size_t k=0; k<cols.size(); k++)
+    memcpy(&res[k*stride],S.column(cols[k]),stride);
+
+  res.attr("individuals")=(double)S.individuals();
+  return res;
+END_RCPP
+};
+
+SEXP waffect_store_count(SEXP rfile, SEXP rmask) {
+BEGIN_RCPP
+  store_reader S(CHAR(STRING_ELT(rfile,0)));
+  std::vector<unsigned char> mask=packedmask(rmask,S.individuals());
+  IntegerVector res(S.size());
+
+  // straight from the mapping
+  for (size_t k=0; k<S.size(); k++)
+    res[k]=(int)packed_count(S.column(k),mask.empty() ? 0 : &mask[0],S.header.stride);
+  return res;
+END_RCPP
+};
+
+
+
+double modelpi(SEXP rgeno, SEXP rmodel, double target, std::vector<double> &pi) {
+  List spec(rmodel);
+  model M;
+  M.type=as<int>(spec["type"]);
+  M.f0=as<double>(spec["f0"]);
+
+  // SNP indices are 1-based in R
+  IntegerVector snp=spec["snp"],first=spec["first"],second=spec["second"];
+  NumericVector beta=spec["beta"],gamma=spec["gamma"],alpha=spec["alpha"];
+  for (size_t k=0; k<(size_t)snp.size(); k++)
+    M.snp.push_back(snp[k]-1);
+  for (size_t k=0; k<(size_t)first.size(); k++) {
+    M.first.push_back(first[k]-1);
+    M.second.push_back(second[k]-1);
+  }
+  M.beta.assign(beta.begin(),beta.end());
+  M.gamma.assign(gamma.begin(),gamma.end());
+  M.alpha.assign(alpha.begin(),alpha.end());
+
+  // genotypes read by waffect_readped (2 bits), or integers or raw bytes,
+  // one column per SNP
+  size_t n,nsnp;
+  if (TYPEOF(rgeno)==EXTPTRSXP) {
+    XPtr<genotypes> g(rgeno);
+    n=g->individuals();
+    nsnp=g->snps();
+  } else if (TYPEOF(rgeno)==RAWSXP) {
+    RawMatrix g(rgeno);
+    n=g.nrow();
+    nsnp=g.ncol();
+  } else {
+    IntegerMatrix g(rgeno);
+    n=g.nrow();
+    nsnp=g.ncol();
+  }
+  SEXP rcov=spec["covariates"];
+  if (!Rf_isNull(rcov)) {
+    NumericMatrix cov(rcov);
+    if ((size_t)cov.nrow()!=n)
+      throw std::invalid_argument("one row of covariates per individual is needed");
+    M.cov=cov.begin();
+    M.ncov=cov.ncol();
+  }
+
+  pi.resize(n);
+  if (TYPEOF(rgeno)==EXTPTRSXP)
+    return model_pi(M,*XPtr<genotypes>(rgeno),&pi[0],target);
+  if (TYPEOF(rgeno)==RAWSXP)
+    return model_pi(M,RawMatrix(rgeno).begin(),n,nsnp,&pi[0],target);
+  return model_pi(M,IntegerMatrix(rgeno).begin(),n,nsnp,&pi[0],target);
+};
+
+SEXP waffect_model_pi(SEXP rgeno, SEXP rmodel, SEXP rtarget) {
+BEGIN_RCPP
+  std::vector<double> pi;
+  double f0=modelpi(rgeno,rmodel,*REAL(rtarget),pi);
+  NumericVector res(pi.begin(),pi.end());
+  res.attr("f0")=f0;
+  return res;
+END_RCPP
+};
+
+SEXP waffectbin_model(SEXP rgeno, SEXP rmodel, SEXP rtarget, SEXP rr, SEXP rnsim, SEXP rmethod, SEXP rscaled, SEXP rbudget, SEXP rseed, SEXP rthreads, SEXP rpacked) {
+BEGIN_RCPP
+  size_t r=*INTEGER(rr);
+  size_t nsim=*INTEGER(rnsim);
+  int nthreads=*INTEGER(rthreads);
+  double budget=*REAL(rbudget);
+
+  // pi only lives on the C++ side, replicate k is stream k of the seed
+  std::vector<double> pi;
+  double f0=modelpi(rgeno,rmodel,*REAL(rtarget),pi);
+  size_t q=pi.size();
+  uint64_t seed=streamseed(rseed);
+  generator G(q>0 ? &pi[0] : 0,q,r,*INTEGER(rmethod),*LOGICAL(rscaled),R_FINITE(budget) ? budget : 0.0,nsim,nthreads);
+
+  if (*LOGICAL(rpacked)) {
+    RawMatrix res(packed_bytes(q),nsim);
+    G.block_packed(&res[0],0,nsim,seed,nthreads);
+    res.attr("individuals")=(double)q;
+    res.attr("f0")=f0;
+    return res;
+  }
+  LogicalMatrix res(q,nsim);
+  G.block(&res[0],0,nsim,seed,nthreads);
+  res.attr("f0")=f0;
+  return res;
+END_RCPP
+};
+
+
+
+SEXP waffect_readped(SEXP rped, SEXP rmap) {
+BEGIN_RCPP
+  XPtr<genotypes> G(new genotypes,true);
+  G->read(CHAR(STRING_ELT(rped,0)),CHAR(STRING_ELT(rmap,0)));
+
+  List fam=List::create(Named("fid")=G->fid,Named("iid")=G->iid,Named("pat")=G->pat,
+			Named("mat")=G->mat,Named("sex")=G->sex,Named("pheno")=G->pheno);
+  std::vector<std::string> minor(G->m),major(G->m);
+  for (size_t s=0; s<G->m; s++) {
+    minor[s]=std::string(1,G->minor[s]);
+    major[s]=std::string(1,G->major[s]);
+  }
+  List map=List::create(Named("chr")=G->chr,Named("snp")=G->snp,Named("cm")=G->cm,Named("bp")=G->bp,
+			Named("minor")=minor,Named("major")=major,
+			Named("count")=NumericVector(G->count.begin(),G->count.end()),
+			Named("missing")=NumericVector(G->missing.begin(),G->missing.end()));
+  return List::create(Named("ptr")=G,Named("individuals")=(double)G->n,Named("snps")=(double)G->m,
+		      Named("fam")=fam,Named("map")=map);
+END_RCPP
+};
+
+SEXP waffect_genotypes(SEXP rgeno, SEXP rsnp) {
+BEGIN_RCPP
+  XPtr<genotypes> G(rgeno);
+  IntegerVector snp(rsnp);
+  size_t n=G->n;
+  IntegerMatrix res(n,snp.size());
+
+  // minor allele counts, NA if missing
+  for (size_t k=0; k<(size_t)snp.size(); k++) {
+    if (snp[k]<1 || (size_t)snp[k]>G->m)
+      throw std::invalid_argument("SNP out of the genotype matrix");
+    for (size_t i=0; i<n; i++) {
+      unsigned g=G->get(i,snp[k]-1);
+      res[k*n+i]=g==3 ? NA_INTEGER : (int)g;
+    }
+  }
   return res;
+END_RCPP
 };
@@ -8,22 +8,60 @@
 #include <iostream>
 #include <unistd.h>
 #include <time.h>
-#include "xdouble.h"
+#include <string>
+#include <waffect/core.h>
+#include <waffect/plink.h>
 
 
-/* return true with probability prob, false else */
-bool draw(xdouble prob);
-bool draw(double prob);
+void print(waffect::btable<waffect::xdouble> &B);
 
-/* compute backward quantities ... */
-size_t backward(size_t r,size_t h,size_t j,Rcpp::NumericVector &pi,std::vector<std::vector<xdouble> > &B);
+/* R's own generator (set.seed), only within GetRNGstate()/PutRNGstate() */
+struct rrng {
+  double unif() { return unif_rand(); }
+  size_t index(size_t n) {
+    size_t k=(size_t)(unif_rand()*(double)n);
+    return k<n ? k : n-1;
+  }
+};
 
-void print(std::vector<std::vector<xdouble> > &B);
+/* seed argument from R: NULL or NA selects rrng, a number selects philox */
+bool rseeded(SEXP rseed);
+uint64_t seedvalue(SEXP rseed);
+/* seed for philox streams: rseed, or drawn from R's generator if NULL or NA */
+uint64_t streamseed(SEXP rseed);
+/* logical vector of individuals (NULL: all) packed as in packed.h */
+std::vector<unsigned char> packedmask(SEXP rmask, size_t q);
+/* pi of a disease model made by waffectmodel() (R list), returns f0 */
+double modelpi(SEXP rgeno, SEXP rmodel, double target, std::vector<double> &pi);
 
 //SEXP waffectbin(std::vector<xdouble> &pi,size_t r,size_t h=0,bool verbose=false);
-RcppExport SEXP waffectbin(SEXP rpi, SEXP rr, SEXP rh);
-RcppExport SEXP waffectbin_mcmc(SEXP rpi, SEXP rr, SEXP rburnin);
-RcppExport SEXP waffectbin_reject(SEXP rpi, SEXP rr);
+RcppExport SEXP waffectbin(SEXP rpi, SEXP rr, SEXP rbudget, SEXP rscaled, SEXP rtol, SEXP rseed);
+RcppExport SEXP waffectbin_mcmc(SEXP rpi, SEXP rr, SEXP rburnin, SEXP rthin, SEXP rnsim, SEXP rweighted, SEXP rseed);
+RcppExport SEXP waffectbin_reject(SEXP rpi, SEXP rr, SEXP rseed);
+RcppExport SEXP waffectbin_prepare(SEXP rpi, SEXP rr, SEXP rscaled, SEXP rtol);
+RcppExport SEXP waffectbin_sample(SEXP rsampler, SEXP rnsim, SEXP rseed, SEXP rthreads);
+RcppExport SEXP waffect_dynamic(SEXP rpi, SEXP rr, SEXP rthreads);
+RcppExport SEXP waffect_dynamic_update(SEXP rgen, SEXP rj, SEXP rpi, SEXP rthreads);
+RcppExport SEXP waffect_dynamic_sample(SEXP rgen, SEXP rnsim, SEXP rseed, SEXP rthreads, SEXP rpacked);
+RcppExport SEXP waffectbin_plan(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rbudget);
+RcppExport SEXP waffect_marginal(SEXP rpi, SEXP rr, SEXP rscaled, SEXP rbudget);
+RcppExport SEXP waffect_multiclass(SEXP rprob, SEXP rcount, SEXP rnsim, SEXP rmethod, SEXP rburnin, SEXP rweighted, SEXP rscaled, SEXP rbudget, SEXP rtol, SEXP rseed);
+RcppExport SEXP waffectbin_batch(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rmethod, SEXP rscaled, SEXP rbudget, SEXP rtol, SEXP rseed, SEXP rthreads);
+RcppExport SEXP waffectbin_fft(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rseed, SEXP rthreads);
+RcppExport SEXP waffectbin_mchain(SEXP rpi, SEXP rr, SEXP rburnin, SEXP rthin, SEXP rnsim, SEXP rweighted, SEXP rchains, SEXP rseed, SEXP rthreads);
+RcppExport SEXP waffectbin_grouped(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rseed, SEXP rthreads);
+RcppExport SEXP waffectbin_packed(SEXP rpi, SEXP rr, SEXP rnsim, SEXP rmethod, SEXP rscaled, SEXP rbudget, SEXP rseed, SEXP rthreads);
+RcppExport SEXP waffect_pack(SEXP rres);
+RcppExport SEXP waffect_unpack(SEXP rx, SEXP rn, SEXP rcols);
+RcppExport SEXP waffect_count(SEXP rx, SEXP rn, SEXP rmask);
+RcppExport SEXP waffect_store(SEXP rfile, SEXP rpi, SEXP rr, SEXP rnsim, SEXP rmethod, SEXP rscaled, SEXP rbudget, SEXP rseed, SEXP rthreads, SEXP rappend);
+RcppExport SEXP waffect_store_info(SEXP rfile);
+RcppExport SEXP waffect_store_read(SEXP rfile, SEXP rcols);
+RcppExport SEXP waffect_store_count(SEXP rfile, SEXP rmask);
+RcppExport SEXP waffect_model_pi(SEXP rgeno, SEXP rmodel, SEXP rtarget);
+RcppExport SEXP waffect_readped(SEXP rped, SEXP rmap);
+RcppExport SEXP waffect_genotypes(SEXP rgeno, SEXP rsnp);
+RcppExport SEXP waffectbin_model(SEXP rgeno, SEXP rmodel, SEXP rtarget, SEXP rr, SEXP rnsim, SEXP rmethod, SEXP rscaled, SEXP rbudget, SEXP rseed, SEXP rthreads, SEXP rpacked);
 
 /*
  * note : RcppExport is an alias to `extern "C"` defined by Rcpp.
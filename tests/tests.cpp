@@ -0,0 +1,1144 @@
+/*
+ * Checks of the engines without R: every engine draws configurations of
+ * small models (q<=12) whose inclusion probabilities P(Y_j=1 | r cases)
+ * are computed by enumerating the subsets, and its frequencies must stay
+ * within a few standard errors of them. The seeds are fixed, so that a run
+ * is reproducible. One section per feature of the library.
+ *   make check    build ./tests and run it
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <waffect/core.h>
+#include <waffect/plink.h>
+
+using namespace waffect;
+
+static const char *section="";
+static size_t checked=0,failed=0;
+
+static void check(bool ok,const std::string &what,int line) {
+  checked++;
+  if (ok)
+    return;
+  failed++;
+  fprintf(stderr,"%s: line %d: %s\n",section,line,what.c_str());
+}
+
+#define CHECK(c) check((c),#c,__LINE__)
+
+/* the statement throws an exception of type E */
+#define THROWS(E,...) do {						\
+    bool thrown=false;							\
+    try { __VA_ARGS__; } catch (E &) { thrown=true; }			\
+    check(thrown,#__VA_ARGS__ " throws " #E,__LINE__);			\
+  } while (0)
+
+/* draws per frequency check */
+static const size_t N=20000;
+
+/* test models: distinct pi, pi in {0,1}, few distinct pi */
+static const double p10[]={0.05,0.1,0.2,0.3,0.5,0.5,0.7,0.8,0.9,0.95};
+static const double p12[]={0.0,1.0,0.2,0.6,0.01,0.99,0.4,0.4,0.3,1.0,0.0,0.7};
+static const double pg[]={0.1,0.1,0.1,0.4,0.4,0.4,0.4,0.8,0.8,0.8,1.0,0.0};
+static const std::vector<double> P10(p10,p10+10),P12(p12,p12+12),PG(pg,pg+12);
+
+/* P(Y_j=1 | r cases) for every j by enumeration of the subsets of r
+ * individuals, returns P(r cases) */
+static double enumerate(const std::vector<double> &pi,size_t r,std::vector<double> &m) {
+  size_t q=pi.size();
+  double total=0.0;
+  m.assign(q,0.0);
+  for (uint64_t s=0; s<((uint64_t)1<<q); s++) {
+    if (popcount64(s)!=r)
+      continue;
+    double w=1.0;
+    for (size_t j=0; j<q; j++)
+      w*=(s>>j)&1 ? pi[j] : 1.0-pi[j];
+    total+=w;
+    for (size_t j=0; j<q; j++)
+      if ((s>>j)&1)
+	m[j]+=w;
+  }
+  for (size_t j=0; j<q; j++)
+    m[j]/=total;
+  return total;
+}
+
+/* |f-p| in standard errors of a frequency over n draws (0 or infinite if p
+ * is 0 or 1) */
+static double zscore(double f,double p,size_t n) {
+  double se=sqrt(p*(1.0-p)/(double)n);
+  if (!(se>0.0))
+    return fabs(f-p)<1e-12 ? 0.0 : HUGE_VAL;
+  return fabs(f-p)/se;
+}
+
+typedef std::function<void(int *,uint64_t)> drawer;
+
+/* nsim configurations draw(y,k): each has r cases, the individuals with pi
+ * 0 or 1 keep their status and the inclusion frequencies are within zmax
+ * standard errors of the exact ones */
+static void frequencies(const std::string &name,const std::vector<double> &pi,size_t r,size_t nsim,drawer draw,double zmax=5.0) {
+  size_t q=pi.size();
+  std::vector<double> exact;
+  enumerate(pi,r,exact);
+  std::vector<size_t> n(q,0);
+  std::vector<int> y(q);
+  bool valid=true;
+  for (size_t k=0; k<nsim; k++) {
+    draw(&y[0],k);
+    size_t cases=0;
+    for (size_t j=0; j<q; j++) {
+      valid=valid && (y[j]==0 || y[j]==1) && !(pi[j]<=0.0 && y[j]) && !(pi[j]>=1.0 && !y[j]);
+      cases+=y[j]!=0;
+      n[j]+=y[j]!=0;
+    }
+    valid=valid && cases==r;
+  }
+  double worst=0.0;
+  for (size_t j=0; j<q; j++)
+    worst=std::max(worst,zscore((double)n[j]/(double)nsim,exact[j],nsim));
+  check(valid,name+": configurations with r cases",__LINE__);
+  char z[64];
+  snprintf(z,sizeof(z),": largest z %.2f",worst);
+  check(worst<zmax,name+z,__LINE__);
+}
+
+/* prepared sampler: one backward table for every replicate */
+static void prepared() {
+  section="prepared sampler";
+  sampler s(&P10[0],P10.size(),4,false,0.0);
+  frequencies("sampler",P10,4,N,[&](int *y,uint64_t k) { philox g(1,k); s.sample(y,g); });
+  sampler t(&P12[0],P12.size(),5,false,0.0);
+  frequencies("sampler, fixed individuals",P12,5,N,[&](int *y,uint64_t k) { philox g(2,k); t.sample(y,g); });
+
+  // the table is only read: same stream, same configuration
+  std::vector<int> a(10),b(10);
+  philox g(3,7),h(3,7);
+  s.sample(&a[0],g);
+  s.sample(&b[0],h);
+  CHECK(a==b);
+  THROWS(std::invalid_argument,sampler x(&P10[0],P10.size(),11,false,0.0));
+}
+
+template <class T>
+static void storage(size_t h,size_t w) {
+  btable<T> B(h,w);
+  bool aligned=true,zero=true;
+  for (size_t i=0; i<h; i++) {
+    aligned=aligned && reinterpret_cast<size_t>(B[i])%btable<T>::align==0;
+    for (size_t m=0; m<w; m++)
+      zero=zero && B[i][m]==T(0.0);
+    zero=zero && B.scale(i)==0 && B.lo(i)==0 && B.hi(i)==w-2;
+  }
+  CHECK(aligned);
+  CHECK(zero);
+  CHECK(B.nrow()==h && B.ncol()==w);
+  CHECK(B.rowstride()*sizeof(T)==btable<T>::rowbytes(w));
+  CHECK(btable<T>::rowbytes(w)%btable<T>::align==0 && btable<T>::rowbytes(w)>=w*sizeof(T));
+  CHECK(B.bytes()==h*btable<T>::rowbytes(w));
+  B.resize(0,w);
+  CHECK(B.nrow()==0 && B.bytes()==0);
+}
+
+/* contiguous table: rows on cache lines, cells zeroed */
+static void storage() {
+  section="backward table storage";
+  storage<xdouble>(5,7);
+  storage<xdouble>(3,2);
+  storage<double>(4,13);
+  storage<double>(1,64);
+}
+
+/* row-scaled double table: same draws as the xdouble table, also where
+ * plain doubles underflow */
+static void scaled() {
+  section="row-scaled table";
+  sampler s(&P12[0],P12.size(),5,true,0.0);
+  frequencies("scaled sampler",P12,5,N,[&](int *y,uint64_t k) { philox g(4,k); s.sample(y,g); });
+  sampler t(&P10[0],P10.size(),4,true,0.0);
+  frequencies("scaled sampler, distinct pi",P10,4,N,[&](int *y,uint64_t k) { philox g(5,k); t.sample(y,g); });
+
+  // P(r cases) about 1e-1050 and 1e-20000
+  size_t sizes[]={1000,400},cases[]={500,100};
+  double scale[]={1e-3,1e-200};
+  for (int t=0; t<2; t++) {
+    size_t q=sizes[t],r=cases[t];
+    std::vector<double> pi(q);
+    for (size_t i=0; i<q; i++)
+      pi[i]=scale[t]*(double)(1+i%3);
+    sampler a(&pi[0],q,r,true,0.0),b(&pi[0],q,r,false,0.0);
+    CHECK(b.B[0][0]*xdouble(1.0-pi[0])+b.B[0][1]*xdouble(pi[0])<xdouble(1e-308));
+    std::vector<int> x(q),y(q);
+    size_t same=0;
+    for (uint64_t k=0; k<20; k++) {
+      philox g(6,k),h(6,k);
+      a.sample(&x[0],g);
+      b.sample(&y[0],h);
+      same+=x==y;
+    }
+    check(same==20,"same draws as the xdouble table, q="+std::to_string(q),__LINE__);
+  }
+}
+
+/* a kernel gives the rows of kernel_scalar, bit for bit */
+static bool same_rows(kernel_t kernel) {
+  philox g(7);
+  bool same=true;
+  for (size_t len=1; len<=40; len++)
+    for (size_t lo=0; lo<3; lo++) {
+      size_t hi=lo+len-1;
+      std::vector<double> prev(hi+2),a(hi+2,0.0),b(hi+2,0.0);
+      for (size_t m=0; m<prev.size(); m++)
+	prev[m]=g.unif();
+      double p=g.unif();
+      double ma=kernel_scalar(&a[0],&prev[0],p,lo,hi);
+      double mb=kernel(&b[0],&prev[0],p,lo,hi);
+      same=same && ma==mb && a==b;
+    }
+  return same;
+}
+
+/* vectorized backward kernels */
+static void kernels() {
+  section="backward kernels";
+  const char *name=backward_kernel_name();
+  CHECK(!strcmp(name,"scalar") || !strcmp(name,"avx2") || !strcmp(name,"avx512"));
+  CHECK(same_rows(backward_kernel));
+#ifdef WAFFECT_X86_DISPATCH
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    CHECK(same_rows(kernel_avx2));
+  if (__builtin_cpu_supports("avx512f"))
+    CHECK(same_rows(kernel_avx512));
+#endif
+}
+
+/* checkpointed backward pass within a memory budget */
+static void checkpointed() {
+  section="checkpointed backward pass";
+  frequencies("checkpoints every 3 rows",P12,5,N,[&](int *y,uint64_t k) {
+      philox g(8,k);
+      forward_checkpoint<xdouble>(5,3,&P12[0],P12.size(),y,g);
+    });
+  // 10 rows do not fit in 8, 3 checkpoints and a segment of 4 do
+  double budget=8.0*btable<double>::rowbytes(6);
+  CHECK(segment_length<double>(10,4,budget)==4);
+  CHECK(segment_length<double>(10,4,0.0)==10);
+  frequencies("scaled, within a budget",P10,4,N,[&](int *y,uint64_t k) {
+      philox g(9,k);
+      forward_budget<double>(4,budget,&P10[0],P10.size(),y,g);
+    });
+
+  // the segments are recomputed from the checkpoints: the draws of the
+  // whole table
+  sampler s(&P10[0],P10.size(),4,false,0.0);
+  std::vector<int> x(10),y(10);
+  size_t same=0;
+  for (uint64_t k=0; k<200; k++) {
+    philox g(10,k),h(10,k);
+    s.sample(&x[0],g);
+    forward_checkpoint<xdouble>(4,3,&P10[0],P10.size(),&y[0],h);
+    same+=x==y;
+  }
+  CHECK(same==200);
+  THROWS(std::length_error,philox g(1); forward_budget<double>(4,1.0,&P10[0],P10.size(),&y[0],g));
+}
+
+/* feasibility band and truncation of the rows */
+static void truncated() {
+  section="band and truncation";
+  sampler s(&P10[0],P10.size(),4,false,1e-12);
+  frequencies("tolerance 1e-12",P10,4,N,[&](int *y,uint64_t k) { philox g(11,k); s.sample(y,g); });
+  CHECK(s.discarded>=0.0 && s.discarded<1e-10);
+
+  // nothing outside the band of each row
+  sampler t(&P12[0],P12.size(),5,false,0.0);
+  bool band=true;
+  for (size_t i=0; i<P12.size(); i++) {
+    size_t lo=t.B.lo(i),hi=t.B.hi(i);
+    band=band && lo<=hi && hi<=i+1;
+    for (size_t m=0; m<=6; m++)
+      if (m<lo || m>hi)
+	band=band && t.B[i][m]==xdouble(0.0);
+  }
+  CHECK(band);
+  CHECK(t.discarded==0.0);
+
+  // a coarse tolerance drops mass, and says so
+  sampler u(&P10[0],P10.size(),4,false,0.2);
+  CHECK(u.discarded>0.0);
+}
+
+/* counter-based generator: (seed, stream, position) */
+static void rng() {
+  section="counter-based generator";
+  philox a(12,3),b(12,3),c(12,4),d(13,3),e(12);
+  e.stream(3);
+  bool same=true,other=false,other_seed=false;
+  std::vector<uint32_t> words;
+  for (int k=0; k<1000; k++) {
+    uint32_t x=a.next();
+    words.push_back(x);
+    same=same && x==b.next() && x==e.next();
+    other=other || x!=c.next();
+    other_seed=other_seed || x!=d.next();
+  }
+  CHECK(same);
+  CHECK(other);
+  CHECK(other_seed);
+
+  // block pos starts with word 4*pos
+  philox f(12,3);
+  f.jump(10);
+  CHECK(f.next()==words[40] && f.next()==words[41]);
+
+  philox g(14);
+  double sum=0.0,lowest=1.0,highest=0.0;
+  size_t n=1000000;
+  std::vector<size_t> count(10,0);
+  for (size_t k=0; k<n; k++) {
+    double u=g.unif();
+    sum+=u;
+    lowest=std::min(lowest,u);
+    highest=std::max(highest,u);
+    count[g.index(10)]++;
+  }
+  CHECK(lowest>=0.0 && highest<1.0);
+  CHECK(zscore(sum/(double)n,0.5,12*n/4)<5.0);
+  bool uniform=true;
+  for (size_t i=0; i<10; i++)
+    uniform=uniform && zscore((double)count[i]/(double)n,0.1,n)<5.0;
+  CHECK(uniform);
+  CHECK(g.index(1)==0);
+}
+
+/* replicates on several threads: replicate k from stream k of the seed */
+static void batch() {
+  section="batch of replicates";
+  size_t q=P12.size(),nsim=200;
+  sampler s(&P12[0],q,5,false,0.0);
+  std::vector<int> one(q*nsim),four(q*nsim),y(q);
+  s.batch(&one[0],nsim,15,1);
+  s.batch(&four[0],nsim,15,4);
+  CHECK(one==four);
+  bool streams=true;
+  for (uint64_t k=0; k<nsim; k++) {
+    philox g(15,k);
+    s.sample(&y[0],g);
+    streams=streams && std::equal(y.begin(),y.end(),one.begin()+k*q);
+  }
+  CHECK(streams);
+
+  // the prepared engine of each method, the checkpoints of a budget
+  int methods[]={0,2,3,4};
+  for (int t=0; t<4; t++) {
+    generator G(&PG[0],q,5,methods[t],false,0.0,nsim,4);
+    G.block(&one[0],0,nsim,16,1);
+    G.block(&four[0],0,nsim,16,4);
+    check(one==four,"method "+std::to_string(methods[t])+": same replicates on 1 and 4 threads",__LINE__);
+  }
+  generator G(&P12[0],q,5,0,true,8.0*btable<double>::rowbytes(7),N,4);
+  std::vector<int> all(q*N);
+  G.block(&all[0],0,N,17,4);
+  frequencies("batch, scaled within a budget",P12,5,N,[&](int *y,uint64_t k) { std::copy(&all[k*q],&all[(k+1)*q],y); });
+}
+
+/* P(cls_j=k+1) of the multiclass model, accumulated in m[j*K+k]: class k
+ * is a conditional Bernoulli draw among the individuals left, with
+ * pi_j=prob[k,j]/sum_{l>=k} prob[l,j] */
+static void enumerate_classes(const std::vector<double> &prob,size_t K,const std::vector<int> &count,size_t k,uint64_t left,double w,std::vector<double> &m) {
+  size_t n=prob.size()/K;
+  if (k+1==K) {
+    for (size_t j=0; j<n; j++)
+      if ((left>>j)&1)
+	m[j*K+k]+=w;
+    return;
+  }
+  std::vector<double> pi(n,0.0);
+  for (size_t j=0; j<n; j++) {
+    double suffix=0.0;
+    for (size_t l=k; l<K; l++)
+      suffix+=prob[j*K+l];
+    pi[j]=suffix>0.0 ? std::min(prob[j*K+k]/suffix,1.0) : 0.0;
+  }
+  std::vector<uint64_t> subsets;
+  std::vector<double> weight;
+  double total=0.0;
+  for (uint64_t s=left; ; s=(s-1)&left) {
+    if (popcount64(s)==(size_t)count[k]) {
+      double x=1.0;
+      for (size_t j=0; j<n; j++)
+	if ((left>>j)&1)
+	  x*=(s>>j)&1 ? pi[j] : 1.0-pi[j];
+      subsets.push_back(s);
+      weight.push_back(x);
+      total+=x;
+    }
+    if (s==0)
+      break;
+  }
+  for (size_t t=0; t<subsets.size(); t++) {
+    double x=w*weight[t]/total;
+    for (size_t j=0; j<n; j++)
+      if ((subsets[t]>>j)&1)
+	m[j*K+k]+=x;
+    enumerate_classes(prob,K,count,k+1,left&~subsets[t],x,m);
+  }
+}
+
+/* K classes in one call */
+static void multiclass() {
+  section="multiclass";
+  size_t K=3,n=7;
+  std::vector<int> count={2,3,2};
+  std::vector<double> prob(K*n),exact(K*n,0.0);
+  philox g(18);
+  for (size_t t=0; t<K*n; t++)
+    prob[t]=0.05+g.unif();
+  enumerate_classes(prob,K,count,0,((uint64_t)1<<n)-1,1.0,exact);
+
+  int methods[]={BACKWARD,REJECT,FFT};
+  for (int t=0; t<3; t++) {
+    std::vector<size_t> freq(K*n,0);
+    std::vector<int> cls(n);
+    bool valid=true;
+    philox h(19,t);
+    for (size_t k=0; k<N; k++) {
+      sample_multiclass(prob,K,count,cls,h,options(methods[t]));
+      std::vector<int> size(K,0);
+      for (size_t j=0; j<n; j++) {
+	valid=valid && cls[j]>=1 && cls[j]<=(int)K;
+	size[cls[j]-1]++;
+	freq[j*K+cls[j]-1]++;
+      }
+      valid=valid && size==count;
+    }
+    double worst=0.0;
+    for (size_t c=0; c<K*n; c++)
+      worst=std::max(worst,zscore((double)freq[c]/(double)N,exact[c],N));
+    std::string name="method "+std::to_string(methods[t]);
+    check(valid,name+": class sizes",__LINE__);
+    check(worst<5.0,name+": class frequencies",__LINE__);
+  }
+  std::vector<int> cls(n),two={2,5};
+  THROWS(std::invalid_argument,sample_multiclass(prob,K,two,cls,g));
+  std::vector<int> more={2,3,3},negative={8,-1,0};
+  THROWS(std::invalid_argument,sample_multiclass(prob,K,more,cls,g));
+  THROWS(std::invalid_argument,sample_multiclass(prob,K,negative,cls,g));
+
+  // classes with a zero count, also once everybody is affected
+  std::vector<std::vector<int> > empty={{7,0,0},{0,7,0},{0,0,7},{3,0,4}};
+  for (size_t t=0; t<empty.size(); t++)
+    for (int m=BACKWARD; m<=AUTO; m++) {
+      sample_multiclass(prob,K,empty[t],cls,g,options(m));
+      std::vector<int> size(K,0);
+      for (size_t j=0; j<n; j++)
+	size[cls[j]-1]++;
+      CHECK(size==empty[t]);
+    }
+}
+
+/* product tree of the generating polynomials */
+static void producttree() {
+  section="product tree";
+  std::vector<size_t> work;
+  ptree T(&P12[0],P12.size(),5);
+  frequencies("ptree, fixed individuals",P12,5,N,[&](int *y,uint64_t k) { T.sample(y,20,k,work); });
+  ptree U(&P10[0],P10.size(),4);
+  frequencies("ptree",P10,4,N,[&](int *y,uint64_t k) { U.sample(y,21,k,work); });
+
+  // node v uses block v of the stream: the threads do not matter
+  size_t q=300;
+  std::vector<double> pi(q);
+  philox g(22);
+  for (size_t i=0; i<q; i++)
+    pi[i]=g.unif();
+  ptree V(&pi[0],q,100,4);
+  std::vector<int> x(q),y(q);
+  size_t same=0;
+  for (uint64_t k=0; k<10; k++) {
+    V.sample(&x[0],23,k,work,1);
+    V.sample(&y[0],23,k,work,4);
+    same+=x==y;
+  }
+  CHECK(same==10);
+
+  // the structural zeros stay exact over a deep tree
+  q=2000;
+  pi.resize(q);
+  for (size_t i=0; i<q; i++)
+    pi[i]=i%4==0 ? 1.0 : (i%4==1 ? 0.0 : 0.3);
+  ptree W(&pi[0],q,800);
+  x.resize(q);
+  bool fixed=true;
+  for (uint64_t k=0; k<20; k++) {
+    W.sample(&x[0],24,k,work);
+    size_t cases=0;
+    for (size_t i=0; i<q; i++) {
+      cases+=x[i];
+      fixed=fixed && !(pi[i]==1.0 && !x[i]) && !(pi[i]==0.0 && x[i]);
+    }
+    fixed=fixed && cases==800;
+  }
+  CHECK(fixed);
+  THROWS(std::invalid_argument,ptree Z(&P10[0],P10.size(),11));
+}
+
+/* groups of equal pi */
+static void groups() {
+  section="grouped sampler";
+  std::vector<size_t> work;
+  grouped G(&PG[0],PG.size(),5);
+  CHECK(G.prob.size()==3 && G.ones.size()==1);
+  frequencies("grouped",PG,5,N,[&](int *y,uint64_t k) { philox g(25,k); G.sample(y,g,work); });
+  grouped H(&P12[0],P12.size(),5);
+  frequencies("grouped, distinct pi",P12,5,N,[&](int *y,uint64_t k) { philox g(26,k); H.sample(y,g,work); });
+  THROWS(std::invalid_argument,grouped Z(&PG[0],PG.size(),0));
+  THROWS(std::invalid_argument,grouped Z(&PG[0],PG.size(),12));
+}
+
+/* nchains chains of nsim replicates of opt in the columns of res */
+static void chains(const std::vector<double> &pi,size_t r,const mcmcopt &opt,size_t nchains,size_t nsim,uint64_t seed,std::vector<int> &res,bool &converged) {
+  size_t q=pi.size();
+  res.resize(q*nchains*nsim);
+  converged=true;
+  for (size_t c=0; c<nchains; c++) {
+    philox g(seed,c);
+    mcmcinfo info=mcmc_run(&pi[0],q,r,opt,&res[c*nsim*q],nsim,g);
+    converged=converged && info.converged && info.acceptance>0.0 && info.acceptance<=1.0;
+  }
+}
+
+/* Metropolis-Hastings swaps, automatic burn-in and thinning */
+static void mcmcsampler() {
+  section="mcmc";
+  size_t q=P10.size();
+  frequencies("fixed burn-in of 200 steps",P10,4,N,[&](int *y,uint64_t k) { philox g(27,k); mcmc(&P10[0],q,4,200,y,g); });
+
+  mcmcopt opt;
+  opt.burnin=0;
+  opt.maxburnin=10000*q;
+  opt.thin=5*q;
+  opt.weighted=false;
+  std::vector<int> res;
+  bool converged;
+  chains(P12,5,opt,100,N/100,28,res,converged);
+  CHECK(converged);
+  frequencies("automatic burn-in, thinned",P12,5,N,[&](int *y,uint64_t k) { std::copy(&res[k*12],&res[(k+1)*12],y); },6.0);
+}
+
+/* weighted proposals */
+static void weighted() {
+  section="weighted mcmc";
+  philox g(29);
+  std::vector<double> w(37);
+  for (size_t i=0; i<w.size(); i++)
+    w[i]=i%5==0 ? 0.0 : g.unif();
+  fenwick F(w.size());
+  F.assign(&w[0]);
+  w[3]=2.5;
+  F.set(3,2.5);
+  w[0]=0.7;
+  F.set(0,0.7);
+  double total=0.0;
+  for (size_t i=0; i<w.size(); i++)
+    total+=w[i];
+  CHECK(fabs(F.total()-total)<1e-12);
+  bool found=true;
+  for (int t=0; t<1000; t++) {
+    double u=g.unif()*total,s=0.0;
+    size_t i=0;
+    while (i+1<w.size() && s+w[i]<=u)
+      s+=w[i++];
+    found=found && F.find(u)==i;
+  }
+  CHECK(found);
+
+  mcmcopt opt;
+  opt.burnin=0;
+  opt.maxburnin=120000;
+  opt.thin=60;
+  opt.weighted=true;
+  std::vector<int> res;
+  bool converged;
+  chains(P12,5,opt,100,N/100,30,res,converged);
+  CHECK(converged);
+  frequencies("weighted proposals",P12,5,N,[&](int *y,uint64_t k) { std::copy(&res[k*12],&res[(k+1)*12],y); },6.0);
+}
+
+/* chains run in parallel, burn-in by R-hat */
+static void multichain() {
+  section="parallel chains";
+  size_t q=P12.size(),nsim=N/4;
+  mcmcopt opt;
+  opt.burnin=0;
+  opt.maxburnin=10000*q;
+  opt.thin=5*q;
+  for (int w=0; w<2; w++) {
+    opt.weighted=w;
+    std::vector<int> one(q*N),four(q*N);
+    mchaininfo info=mchain_run(&P12[0],q,5,opt,4,&four[0],nsim,31,4);
+    mchain_run(&P12[0],q,5,opt,4,&one[0],nsim,31,1);
+    std::string name=w ? "weighted chains" : "chains";
+    check(one==four,name+": same replicates on 1 and 4 threads",__LINE__);
+    bool rhat=info.converged && info.acceptance.size()==4;
+    for (size_t b=0; b<info.rhat.size(); b++)
+      rhat=rhat && info.rhat[b]<MCHAIN_RHAT;
+    check(rhat,name+": R-hat",__LINE__);
+    frequencies(name,P12,5,N,[&](int *y,uint64_t k) { std::copy(&four[k*q],&four[(k+1)*q],y); },6.0);
+  }
+}
+
+/* exponential tilting and rejection */
+static void rejection() {
+  section="tilted rejection";
+  frequencies("reject",P12,5,N,[&](int *y,uint64_t k) { philox g(32,k); reject(&P12[0],P12.size(),5,y,g); });
+  frequencies("reject, distinct pi",P10,4,N,[&](int *y,uint64_t k) { philox g(33,k); reject(&P10[0],P10.size(),4,y,g); });
+
+  // sum of the tilted pi: r
+  double logtheta=tilt(&P12[0],P12.size(),5),sum=0.0;
+  for (size_t i=0; i<P12.size(); i++)
+    sum+=tilted(P12[i],logtheta);
+  CHECK(fabs(sum-5.0)<1e-8);
+  CHECK(tilted(0.0,logtheta)==0.0 && tilted(1.0,logtheta)==1.0);
+  THROWS(std::invalid_argument,tilt(&P12[0],P12.size(),1));
+}
+
+/* engine chosen by the planner */
+static void automatic() {
+  section="automatic method";
+  size_t q=P12.size();
+  std::vector<size_t> work;
+  generator G(&P12[0],q,5,AUTO,false,0.0,N,1);
+  CHECK(G.method==0 || G.method==2 || G.method==3 || G.method==4);
+  frequencies("generator, auto",P12,5,N,[&](int *y,uint64_t k) { G.sample(y,34,k,work); });
+  philox g(35);
+  std::vector<int> v(q);
+  frequencies("sample, auto",PG,5,N,[&](int *y,uint64_t) {
+      waffect::sample(PG,5,v,g,options(AUTO));
+      std::copy(v.begin(),v.end(),y);
+    });
+
+  plan p=make_plan(&PG[0],q,5,N,0.0);
+  CHECK(p.engine>=0 && p.engine<PLAN_ENGINES && p.cost[p.engine]<HUGE_VAL);
+  CHECK(p.groups==3);
+  // no room for the table
+  p=make_plan(&P12[0],q,5,N,1.0);
+  CHECK(p.engine!=PLAN_BACKWARD);
+  // the variance is the tilted one, whatever the engine: pi'=1/2 here
+  std::vector<double> low(2000,0.01);
+  p=make_plan(&low[0],low.size(),1000,N,0.0);
+  CHECK(fabs(p.variance-500.0)<1e-6);
+}
+
+/* the pi distributions of the benchmark (bench.cpp), on 12 individuals */
+static std::vector<double> shape(int s,philox &g) {
+  static const double few[4]={0.02,0.05,0.1,0.3};
+  std::vector<double> pi(12);
+  for (size_t i=0; i<pi.size(); i++) {
+    double u=g.unif();
+    if (s==0)
+      pi[i]=u;
+    else if (s==1)
+      pi[i]=u*u*u*u;
+    else if (s==2)
+      pi[i]=few[g.index(4)];
+    else
+      pi[i]=u<0.05 ? 0.0 : (u<0.1 ? 1.0 : (u<0.55 ? 1e-6*g.unif() : 1.0-1e-6*g.unif()));
+  }
+  return pi;
+}
+
+/* every engine timed by the benchmark, on its shapes of pi */
+static void shapes() {
+  section="benchmark shapes";
+  static const char *names[]={"uniform","skewed","few","extreme"};
+  philox g(36);
+  for (int s=0; s<4; s++) {
+    std::vector<double> pi=shape(s,g);
+    double sum=0.0;
+    for (size_t i=0; i<pi.size(); i++)
+      sum+=pi[i];
+    size_t r=(size_t)floor(sum+0.5);
+    int methods[]={BACKWARD,FFT,GROUPED,REJECT};
+    for (int t=0; t<4; t++) {
+      binopt opt=options(methods[t]);
+      philox h(37,s*4+t);
+      std::vector<int> v(pi.size());
+      frequencies(std::string(names[s])+", method "+std::to_string(methods[t]),pi,r,N/4,[&](int *y,uint64_t) {
+	  waffect::sample(pi,r,v,h,opt);
+	  std::copy(v.begin(),v.end(),y);
+	});
+    }
+  }
+}
+
+/* header-only interface of core.h */
+static void interface() {
+  section="header-only interface";
+  philox g(38);
+  std::vector<int> v(10);
+  int methods[]={BACKWARD,MCMC,REJECT,FFT,GROUPED,AUTO};
+  for (int t=0; t<6; t++)
+    frequencies("sample, method "+std::to_string(methods[t]),P10,4,N/2,[&](int *y,uint64_t) {
+	waffect::sample(P10,4,v,g,options(methods[t]));
+	std::copy(v.begin(),v.end(),y);
+      });
+
+  // ranges of other element types, C arrays
+  std::array<float,10> pf;
+  std::copy(P10.begin(),P10.end(),pf.begin());
+  std::vector<char> yc(10);
+  std::vector<double> yd(10);
+  int ya[10];
+  waffect::sample(pf,4,yc,g);
+  waffect::sample(P10,4,yd,g);
+  waffect::sample(p10,4,ya,g);
+  CHECK(std::count(yc.begin(),yc.end(),1)==4);
+  CHECK(std::count(yd.begin(),yd.end(),1.0)==4);
+  CHECK(std::count(ya,ya+10,1)==4);
+
+  // one table for a batch, replicate k from stream k
+  size_t q=P12.size(),nsim=50;
+  std::vector<int> a(q*nsim),b(q*nsim);
+  sample_batch(P12,5,a,nsim,39,2);
+  sampler s(&P12[0],q,5,false,0.0);
+  s.batch(&b[0],nsim,39,1);
+  CHECK(a==b);
+
+  std::vector<int> shorter(9);
+  THROWS(std::invalid_argument,waffect::sample(P10,4,shorter,g));
+  THROWS(std::invalid_argument,waffect::sample(P10,11,v,g));
+  THROWS(std::invalid_argument,sample_batch(P12,5,b,nsim+1,39));
+}
+
+/* replicates streamed by blocks, as by the command line generator */
+static void streaming() {
+  section="streamed replicates";
+  size_t q=P12.size(),nsim=100;
+  int methods[]={BACKWARD,REJECT,FFT,GROUPED,AUTO};
+  for (int t=0; t<5; t++) {
+    generator G(&P12[0],q,5,methods[t],false,0.0,nsim,2);
+    std::vector<int> all(q*nsim),part(q*nsim),y(q);
+    std::vector<size_t> work;
+    G.block(&all[0],0,nsim,40,1);
+    G.block(&part[0],0,37,40,2);
+    G.block(&part[37*q],37,nsim-37,40,3);
+    bool same=all==part;
+    for (uint64_t k=0; k<nsim; k++) {
+      G.sample(&y[0],40,k,work);
+      same=same && std::equal(y.begin(),y.end(),all.begin()+k*q);
+    }
+    check(same,"method "+std::to_string(methods[t])+": blocks of replicates",__LINE__);
+  }
+  THROWS(std::invalid_argument,generator G(&P12[0],q,5,MCMC,false,0.0));
+}
+
+/* bit-packed replicates */
+static void packed() {
+  section="bit-packed replicates";
+  philox g(41);
+  size_t sizes[]={1,7,8,9,63,64,65,200};
+  bool same=true,counted=true;
+  for (int t=0; t<8; t++) {
+    size_t q=sizes[t],nbytes=packed_bytes(q);
+    CHECK(nbytes==(q+7)/8);
+    std::vector<int> y(q),z(q),mask(q);
+    for (size_t i=0; i<q; i++) {
+      y[i]=g.unif()<0.3;
+      mask[i]=g.unif()<0.5;
+    }
+    std::vector<unsigned char> col(nbytes),m(nbytes);
+    pack(&y[0],q,&col[0]);
+    pack(&mask[0],q,&m[0]);
+    unpack(&col[0],q,&z[0]);
+    same=same && y==z;
+    size_t all=0,some=0;
+    for (size_t i=0; i<q; i++) {
+      all+=y[i];
+      some+=y[i] && mask[i];
+    }
+    counted=counted && packed_count(&col[0],0,nbytes)==all && packed_count(&col[0],&m[0],nbytes)==some;
+  }
+  CHECK(same);
+  CHECK(counted);
+
+  // packed block: the packed columns of block
+  size_t q=P12.size(),nsim=64,nbytes=packed_bytes(q);
+  generator G(&P12[0],q,5,BACKWARD,false,0.0,nsim,2);
+  std::vector<int> res(q*nsim);
+  std::vector<unsigned char> cols(nbytes*nsim),expected(nbytes*nsim);
+  G.block(&res[0],0,nsim,42,2);
+  G.block_packed(&cols[0],0,nsim,42,2);
+  for (size_t k=0; k<nsim; k++)
+    pack(&res[k*q],q,&expected[k*nbytes]);
+  CHECK(cols==expected);
+}
+
+/* on-disk store of packed replicates */
+static void store() {
+  section="replicate store";
+  const char *file="tests.wst";
+  std::string part=std::string(file)+".part";
+  size_t q=P12.size(),nbytes=packed_bytes(q);
+  uint64_t hash=store_hash(&P12[0],q,5);
+  generator G(&P12[0],q,5,BACKWARD,false,0.0,100,2);
+  std::vector<unsigned char> all(100*nbytes);
+  G.block_packed(&all[0],0,100,43,2);
+
+  // 30 then 70 replicates, the same as 100 at once
+  {
+    store_writer W(file,q,5,43,hash,BACKWARD,false);
+    W.append(&all[0],30);
+    W.close();
+  }
+  {
+    store_writer W(file,q,5,99,hash,BACKWARD,true);
+    CHECK(W.header.seed==43 && W.header.count==30);
+    std::vector<unsigned char> more(70*nbytes);
+    G.block_packed(&more[0],30,70,W.header.seed,1);
+    W.append(&more[0],70);
+    W.close();
+  }
+  {
+    store_reader R(file);
+    CHECK(R.individuals()==q && R.size()==100 && R.header.cases==5 && R.header.hash==hash && R.header.method==BACKWARD);
+    bool same=true;
+    for (size_t k=0; k<100; k++)
+      same=same && memcmp(R.column(k),&all[k*nbytes],nbytes)==0;
+    CHECK(same);
+    THROWS(std::out_of_range,R.column(100));
+  }
+  THROWS(std::invalid_argument,store_writer W(file,q,4,43,store_hash(&P12[0],q,4),BACKWARD,true));
+  THROWS(std::invalid_argument,store_writer W(file,q,5,43,hash,FFT,true));
+
+  // a replacement that does not complete leaves the store as it was
+  {
+    store_writer W(file,q,5,44,hash,BACKWARD,false);
+    W.append(&all[0],1);
+  }
+  {
+    FILE *f=fopen(part.c_str(),"rb");
+    CHECK(f==0);
+    if (f)
+      fclose(f);
+    store_reader R(file);
+    CHECK(R.size()==100 && R.header.seed==43);
+  }
+  {
+    store_writer W(file,q,5,44,hash,BACKWARD,false);
+    W.append(&all[0],2);
+    W.close();
+    store_reader R(file);
+    CHECK(R.size()==2 && R.header.seed==44);
+  }
+
+  // a store cut short, a file that is not a store
+  FILE *f=fopen(file,"r+b");
+  CHECK(f!=0);
+  if (f) {
+    fseek(f,0,SEEK_END);
+    long length=ftell(f);
+    fclose(f);
+    std::vector<char> head(length-1);
+    f=fopen(file,"rb");
+    CHECK(fread(&head[0],1,head.size(),f)==head.size());
+    fclose(f);
+    f=fopen(file,"wb");
+    fwrite(&head[0],1,head.size(),f);
+    fclose(f);
+  }
+  THROWS(std::runtime_error,store_reader R(file));
+  THROWS(std::runtime_error,store_writer W(file,q,5,44,hash,BACKWARD,true));
+  f=fopen(file,"wb");
+  fputs("not a store",f);
+  fclose(f);
+  THROWS(std::invalid_argument,store_reader R(file));
+  remove(file);
+  THROWS(std::runtime_error,store_reader R(file));
+}
+
+/* pi from genotypes */
+static void models() {
+  section="disease models";
+  // 6 individuals, 2 SNPs (column major), 3 and -1 are missing
+  int geno[]={0,1,2,3,1,0, 2,2,0,1,-1,1};
+  double z[]={0.5,-1.0,0.0,2.0,1.0,-0.5};
+  size_t n=6;
+  std::vector<double> pi(n);
+  model M;
+  M.f0=0.1;
+  M.snp.push_back(0);
+  M.beta.push_back(0.5);
+  M.first.push_back(0);
+  M.second.push_back(1);
+  M.gamma.push_back(-0.2);
+  M.cov=z;
+  M.ncov=1;
+  M.alpha.push_back(0.3);
+
+  bool additive=true,multiplicative=true,logistic=true;
+  for (int type=MODEL_ADDITIVE; type<=MODEL_LOGISTIC; type++) {
+    M.type=type;
+    model_pi(M,geno,n,2,&pi[0]);
+    for (size_t j=0; j<n; j++) {
+      double x=dosage(geno[j]),y=dosage(geno[n+j]);
+      double eta=0.5*x-0.2*x*y+0.3*z[j],p;
+      if (type==MODEL_ADDITIVE) {
+	p=std::min(1.0,std::max(0.0,0.1*(1.0+eta)));
+	additive=additive && fabs(pi[j]-p)<1e-12;
+      } else if (type==MODEL_MULTIPLICATIVE) {
+	p=std::min(1.0,0.1*exp(eta));
+	multiplicative=multiplicative && fabs(pi[j]-p)<1e-12;
+      } else {
+	p=1.0/(1.0+exp(-log(0.1/0.9)-eta));
+	logistic=logistic && fabs(pi[j]-p)<1e-12;
+      }
+    }
+  }
+  CHECK(additive);
+  CHECK(multiplicative);
+  CHECK(logistic);
+
+  // calibrated baseline: sum(pi) is the number of cases
+  for (int type=MODEL_ADDITIVE; type<=MODEL_LOGISTIC; type++) {
+    M.type=type;
+    model_pi(M,geno,n,2,&pi[0],2.0);
+    double sum=0.0;
+    for (size_t j=0; j<n; j++)
+      sum+=pi[j];
+    check(fabs(sum-2.0)<1e-8,"model "+std::to_string(type)+": calibrated sum of pi",__LINE__);
+  }
+  THROWS(std::invalid_argument,model_pi(M,geno,n,2,&pi[0],6.5));
+  M.snp.push_back(2);
+  M.beta.push_back(1.0);
+  THROWS(std::invalid_argument,model_pi(M,geno,n,2,&pi[0]));
+  M.beta.pop_back();
+  THROWS(std::invalid_argument,model_pi(M,geno,n,2,&pi[0]));
+}
+
+/* PED/MAP reader: the 2-bit codes against the alleles of the file */
+static void plink() {
+  section="PED/MAP reader";
+  const char *ped="../data/ped.txt.gz",*map="../data/map.txt.gz";
+  genotypes X;
+  X.read(ped,map);
+  size_t n=X.individuals(),m=X.snps();
+  CHECK(n==100 && m==1000);
+  CHECK(X.iid.size()==n && X.snp.size()==m);
+
+  // alleles of the file, the minor one being the less frequent
+  std::vector<std::string> alleles;
+  {
+    gzfields f(ped);
+    std::string s;
+    do {
+      std::vector<std::string> line;
+      while (f.field(s))
+	line.push_back(s);
+      if (f.line==1 || line.size()!=6+2*m)
+	continue;
+      alleles.push_back(std::string());
+      for (size_t t=6; t<line.size(); t++)
+	alleles.back()+=line[t];
+    } while (f.next());
+  }
+  CHECK(alleles.size()==n);
+  bool same=true,dosages=true,minor=true;
+  std::vector<double> x(n);
+  for (size_t s=0; s<m && alleles.size()==n; s++) {
+    std::string seen;
+    size_t count[2]={0,0};
+    for (size_t i=0; i<n; i++)
+      for (int a=0; a<2; a++) {
+	char c=alleles[i][2*s+a];
+	if (missing_allele(c))
+	  continue;
+	if (seen.find(c)==std::string::npos)
+	  seen+=c;
+	count[seen.find(c)]++;
+      }
+    char low=count[0]<count[1] ? seen[0] : (seen.size()>1 ? seen[1] : '0');
+    minor=minor && X.minor[s]==low && X.count[s]==std::min(count[0],count[1]);
+    X.dosages(s,&x[0]);
+    for (size_t i=0; i<n; i++) {
+      char a=alleles[i][2*s],b=alleles[i][2*s+1];
+      unsigned code=missing_allele(a) || missing_allele(b) ? 3 : (a==low)+(b==low);
+      same=same && X.get(i,s)==code;
+      dosages=dosages && x[i]==(code==3 ? 0.0 : (double)code);
+    }
+  }
+  CHECK(minor);
+  CHECK(same);
+  CHECK(dosages);
+
+  // the disease model straight from the 2-bit layout
+  model M;
+  M.type=MODEL_LOGISTIC;
+  M.f0=0.2;
+  M.snp.push_back(0);
+  M.beta.push_back(0.7);
+  M.snp.push_back(10);
+  M.beta.push_back(-0.4);
+  std::vector<double> pi(n);
+  model_pi(M,X,&pi[0],30.0);
+  double sum=0.0;
+  for (size_t i=0; i<n; i++)
+    sum+=pi[i];
+  CHECK(fabs(sum-30.0)<1e-8);
+  THROWS(std::runtime_error,genotypes Y; Y.read("missing.ped","missing.map"));
+}
+
+/* exact marginals, xdouble, scaled and checkpointed */
+static void marginals() {
+  section="exact marginals";
+  const std::vector<double> *models[]={&P10,&P12,&PG};
+  size_t cases[]={4,5,5};
+  for (int t=0; t<3; t++) {
+    const std::vector<double> &pi=*models[t];
+    size_t q=pi.size(),r=cases[t];
+    std::vector<double> exact,m(q);
+    double logp=log(enumerate(pi,r,exact));
+    // the checkpoints and a segment of ceil(sqrt(q)) rows, not the table
+    size_t k=(size_t)ceil(sqrt((double)q));
+    double rows=(double)((q+k-1)/k+k);
+    for (int v=0; v<4; v++) {
+      bool checkpointed=v>=2;
+      double lp=v%2 ? waffect::marginals<double>(r,&pi[0],q,&m[0],checkpointed ? rows*btable<double>::rowbytes(r+2) : 0.0)
+	: waffect::marginals<xdouble>(r,&pi[0],q,&m[0],checkpointed ? rows*btable<xdouble>::rowbytes(r+2) : 0.0);
+      bool close=fabs(lp-logp)<1e-10;
+      for (size_t j=0; j<q; j++)
+	close=close && fabs(m[j]-exact[j])<1e-12;
+      static const char *names[]={"xdouble","scaled","xdouble, checkpointed","scaled, checkpointed"};
+      check(close,std::string(names[v])+": model "+std::to_string(t),__LINE__);
+    }
+    double lp=waffect::marginals(pi,r,m,true);
+    bool close=fabs(lp-logp)<1e-10;
+    for (size_t j=0; j<q; j++)
+      close=close && fabs(m[j]-exact[j])<1e-12;
+    check(close,"core.h: model "+std::to_string(t),__LINE__);
+  }
+  std::vector<double> m(10);
+  THROWS(std::invalid_argument,waffect::marginals(P10,11,m));
+  THROWS(std::length_error,waffect::marginals<double>(4,&P10[0],10,&m[0],1.0));
+}
+
+/* pi updated between draws */
+static void dynamic() {
+  section="dynamic sampler";
+  size_t q=P12.size();
+  std::vector<double> pi(P12);
+  size_t idx[]={2,4,7};
+  double p[]={0.9,0.0,1.0};
+  for (int t=0; t<3; t++)
+    pi[idx[t]]=p[t];
+  std::vector<size_t> work;
+
+  // in place for the product tree, prepared again for the others
+  int methods[]={FFT,BACKWARD,GROUPED};
+  for (int t=0; t<3; t++) {
+    generator G(&P12[0],q,5,methods[t],false,0.0,N,1);
+    G.update(idx,p,3);
+    frequencies("method "+std::to_string(methods[t])+", updated",pi,5,N,[&](int *y,uint64_t k) { G.sample(y,45,k,work); });
+    THROWS(std::out_of_range,size_t i=12; G.update(&i,p,1));
+  }
+
+  // back and forth: the tree of the original pi
+  ptree T(&P12[0],q,5);
+  T.update(idx,p,3);
+  for (int t=0; t<3; t++)
+    p[t]=P12[idx[t]];
+  T.update(idx,p,3,2);
+  frequencies("ptree, updated twice",P12,5,N,[&](int *y,uint64_t k) { T.sample(y,46,k,work); });
+
+  // a bad index or an impossible count leaves the tree as it was
+  size_t bad[]={0,12};
+  THROWS(std::out_of_range,T.update(bad,p,2));
+  // (2 cases left)
+  double zero[8]={0.0};
+  size_t rest[]={2,3,4,5,6,7,8,11};
+  THROWS(std::invalid_argument,T.update(rest,zero,8));
+  {
+    generator G(&P12[0],q,5,FFT,true,0.0,1,1);
+    THROWS(std::out_of_range,G.update(bad,p,2));
+    THROWS(std::invalid_argument,G.update(rest,zero,8));
+    frequencies("generator, failed updates",P12,5,N,[&](int *y,uint64_t k) { G.sample(y,47,k,work); });
+  }
+  frequencies("ptree, failed updates",P12,5,N,[&](int *y,uint64_t k) { T.sample(y,46,k,work); });
+
+  // large trees (FFT products): a small shift keeps the tilt, half of the
+  // pi from 0.5 to 0.01 moves the expected number of cases by 490 standard
+  // deviations and the tilt is solved again. The draws follow the exact
+  // marginals, as those of a new tree.
+  size_t n=2000,half=n/2,r=1000;
+  std::vector<double> big(n,0.5),low(half,0.01),m(n);
+  std::vector<size_t> first(half);
+  for (size_t i=0; i<half; i++)
+    first[i]=i;
+  ptree B(&big[0],n,r,2);
+  double logtheta=B.logtheta;
+  B.update(&first[0],&low[0],10);
+  CHECK(B.logtheta==logtheta);
+  B.update(&first[0],&low[0],half,2);
+  CHECK(B.logtheta!=logtheta);
+  for (size_t i=0; i<half; i++)
+    big[i]=0.01;
+  ptree F(&big[0],n,r);
+  marginals<xdouble>(r,&big[0],n,&m[0]);
+  double exact=0.0;
+  for (size_t i=0; i<half; i++)
+    exact+=m[i];
+  std::vector<int> y(n),z(n);
+  size_t nsim=2000,same=0;
+  double mean=0.0;
+  for (size_t k=0; k<nsim; k++) {
+    B.sample(&y[0],48,k,work);
+    F.sample(&z[0],48,k,work);
+    same+=y==z;
+    for (size_t i=0; i<half; i++)
+      mean+=y[i];
+  }
+  mean/=(double)nsim;
+  CHECK(same==nsim);
+  // the count of the first half has a standard deviation below 10
+  CHECK(fabs(mean-exact)<1.0);
+}
+
+int main() {
+  prepared();
+  storage();
+  scaled();
+  kernels();
+  checkpointed();
+  truncated();
+  rng();
+  batch();
+  multiclass();
+  producttree();
+  groups();
+  mcmcsampler();
+  weighted();
+  multichain();
+  rejection();
+  automatic();
+  shapes();
+  interface();
+  streaming();
+  packed();
+  store();
+  models();
+  plink();
+  marginals();
+  dynamic();
+  printf("%zu checks, %zu failed\n",checked,failed);
+  return failed>0;
+}